@@ -29,38 +29,6 @@
       packages = genSystemAttrs (system: {
         default = self.packages.${system}.tera-launcher-for-linux;
 
-        easylzma =
-          with nixpkgs.legacyPackages.${system};
-          stdenv.mkDerivation (finalAttrs: {
-            pname = "easylzma";
-            version = "0.0.9";
-
-            src = fetchFromGitHub {
-              owner = "PopusBenedictus";
-              repo = "easylzma";
-              rev = "master";
-              hash = "sha256-FddX1Zpb3tlUAVSHfuQ+U2kevWNAWPxtWxbA8G/GHuM=";
-            };
-
-            strictDeps = true;
-
-            nativeBuildInputs = [
-              cmake
-            ];
-
-            installPhase = ''
-              mkdir $out
-              cp -r ${finalAttrs.pname}-${finalAttrs.version}/* $out
-            '';
-
-            meta = {
-              description = "An easy to use, tiny, public domain, C wrapper library around Igor Pavlov's work that can be used to compress and extract lzma files";
-              homepage = "https://github.com/PopusBenedictus/easylzma";
-              license = lib.licenses.publicDomain;
-              mainProgram = "elzma";
-            };
-          });
-
         # TODO: Fix build in Nix sandbox (move network access stuff to fixed output derivation/package)
         #
         # https://bmcgee.ie/posts/2023/02/nix-what-are-fixed-output-derivations-and-why-use-them
@@ -102,8 +70,7 @@
               openssl.dev
               protobufc.dev
               sqlite.dev
-              # TODO: Fix build to source with find_package instead of ExternalProject_Add
-              self.packages.${system}.easylzma
+              xz.dev
             ];
 
             meta = {
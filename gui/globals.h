@@ -27,6 +27,8 @@ extern char wine_base_dir_global[FIXED_STRING_FIELD_SZ];
 extern char torrentprefix_global[FIXED_STRING_FIELD_SZ];
 extern char torrent_file_name[FIXED_STRING_FIELD_SZ];
 extern char torrent_magnet_link[FIXED_STRING_FIELD_SZ];
+extern char torrent_profile_default_global[FIXED_STRING_FIELD_SZ];
+extern char torrent_profile_global[FIXED_STRING_FIELD_SZ];
 extern char patch_url_global[FIXED_STRING_FIELD_SZ];
 extern char auth_url_global[FIXED_STRING_FIELD_SZ];
 extern char server_list_url_global[FIXED_STRING_FIELD_SZ];
@@ -40,6 +42,8 @@ extern bool use_tera_toolbox;
 extern bool save_login_info;
 extern bool plaintext_login_info_storage;
 extern bool torrent_download_enabled;
+extern bool torrent_stream_extract;
+extern int max_concurrent_downloads;
 
 #ifdef __cplusplus
 }
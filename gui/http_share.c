@@ -0,0 +1,156 @@
+/** This program is free software. It comes without any warranty, to
+ * the extent permitted by applicable law. You can redistribute it
+ * and/or modify it under the terms of the Do What The Fuck You Want
+ * To Public License, Version 2, as published by Sam Hocevar. See
+ * http://www.wtfpl.net/ for more details.
+ */
+
+#include "http_share.h"
+
+/* Idle easy handles kept around for reuse. Handles released beyond this are
+   destroyed, their DNS, TLS and connection state lives on in the share. */
+#define HTTP_SHARE_POOL_MAX 8
+
+static CURLSH *share = nullptr;
+
+/* One lock per kind of data libcurl keeps in the share */
+static GMutex share_locks[CURL_LOCK_DATA_LAST];
+
+static GMutex pool_lock;
+static GQueue pool = G_QUEUE_INIT;
+
+/* Guarded by pool_lock. Handles handed out and not yet released, and whether
+   http_share_shutdown() is waiting for them before tearing libcurl down. */
+static guint handles_out = 0;
+static gboolean shutdown_pending = FALSE;
+static gboolean torn_down = FALSE;
+
+/*
+ * share_lock:
+ *
+ * libcurl callback taking the lock guarding one kind of shared data. Login
+ * runs on a GTask worker thread while the updater runs on its own, so the
+ * share is used concurrently.
+ */
+static void share_lock(CURL *handle, curl_lock_data data,
+                       curl_lock_access access, void *userptr) {
+  (void)handle;
+  (void)access;
+  (void)userptr;
+  g_mutex_lock(&share_locks[data]);
+}
+
+/*
+ * share_unlock:
+ *
+ * libcurl callback releasing the lock taken by share_lock().
+ */
+static void share_unlock(CURL *handle, curl_lock_data data, void *userptr) {
+  (void)handle;
+  (void)userptr;
+  g_mutex_unlock(&share_locks[data]);
+}
+
+void http_share_init(void) {
+  curl_global_init(CURL_GLOBAL_DEFAULT);
+  if (share)
+    return;
+
+  share = curl_share_init();
+  if (!share) {
+    g_warning("Unable to create the shared HTTP cache");
+    return;
+  }
+  curl_share_setopt(share, CURLSHOPT_LOCKFUNC, share_lock);
+  curl_share_setopt(share, CURLSHOPT_UNLOCKFUNC, share_unlock);
+  curl_share_setopt(share, CURLSHOPT_SHARE, CURL_LOCK_DATA_DNS);
+  curl_share_setopt(share, CURLSHOPT_SHARE, CURL_LOCK_DATA_SSL_SESSION);
+#if LIBCURL_VERSION_NUM >= 0x073900
+  /* Open connections go into the share as well, so any handle on any
+     thread picks up a live connection to the same host. */
+  curl_share_setopt(share, CURLSHOPT_SHARE, CURL_LOCK_DATA_CONNECT);
+#endif
+}
+
+/*
+ * teardown_due_locked:
+ *
+ * Returns TRUE exactly once, when shutdown was requested and the last handle
+ * has come back. The caller holds pool_lock.
+ */
+static gboolean teardown_due_locked(void) {
+  if (!shutdown_pending || handles_out > 0 || torn_down)
+    return FALSE;
+  torn_down = TRUE;
+  return TRUE;
+}
+
+/*
+ * http_share_teardown:
+ *
+ * Destroys the pooled handles and the share and shuts libcurl down. Only
+ * called once no handle is in use anywhere.
+ */
+static void http_share_teardown(void) {
+  g_mutex_lock(&pool_lock);
+  CURL *easy;
+  while ((easy = g_queue_pop_head(&pool)) != nullptr)
+    curl_easy_cleanup(easy);
+  g_mutex_unlock(&pool_lock);
+
+  if (share) {
+    curl_share_cleanup(share);
+    share = nullptr;
+  }
+  curl_global_cleanup();
+}
+
+CURL *http_share_acquire(void) {
+  g_mutex_lock(&pool_lock);
+  CURL *easy = g_queue_pop_head(&pool);
+  g_mutex_unlock(&pool_lock);
+
+  if (!easy)
+    easy = curl_easy_init();
+  if (!easy)
+    return nullptr;
+  if (share)
+    curl_easy_setopt(easy, CURLOPT_SHARE, share);
+
+  g_mutex_lock(&pool_lock);
+  handles_out++;
+  g_mutex_unlock(&pool_lock);
+  return easy;
+}
+
+void http_share_release(CURL *easy) {
+  if (!easy)
+    return;
+  curl_easy_reset(easy);
+
+  g_mutex_lock(&pool_lock);
+  handles_out--;
+  if (!shutdown_pending && g_queue_get_length(&pool) < HTTP_SHARE_POOL_MAX) {
+    g_queue_push_head(&pool, easy);
+    easy = nullptr;
+  }
+  const gboolean teardown = teardown_due_locked();
+  g_mutex_unlock(&pool_lock);
+
+  if (easy)
+    curl_easy_cleanup(easy);
+  if (teardown)
+    http_share_teardown();
+}
+
+void http_share_shutdown(void) {
+  /* Threads that are still transferring keep the share alive, the last one
+     to release its handle tears it down. */
+  g_mutex_lock(&pool_lock);
+  shutdown_pending = TRUE;
+  const gboolean teardown = teardown_due_locked();
+  g_mutex_unlock(&pool_lock);
+
+  if (teardown)
+    http_share_teardown();
+}
@@ -0,0 +1,31 @@
+/** This program is free software. It comes without any warranty, to
+ * the extent permitted by applicable law. You can redistribute it
+ * and/or modify it under the terms of the Do What The Fuck You Want
+ * To Public License, Version 2, as published by Sam Hocevar. See
+ * http://www.wtfpl.net/ for more details.
+ */
+
+#ifndef HTTP_SHARE_H
+#define HTTP_SHARE_H
+#include <curl/curl.h>
+#include <glib.h>
+
+// Sets up libcurl and the DNS, TLS session and connection caches shared by
+// every request the launcher makes. Must be called before any other http_share function.
+void http_share_init(void);
+
+// Takes an easy handle from the pool, or creates one if the pool is empty.
+// The handle is attached to the shared cache and has default options
+// otherwise. Returns nullptr if no handle could be created.
+CURL *http_share_acquire(void);
+
+// Resets an easy handle and returns it to the pool. Its open connections stay
+// in the shared connection cache, so the next request to the same host skips
+// the TCP and TLS handshakes whichever handle makes it.
+void http_share_release(CURL *easy);
+
+// Releases the pool and the shared cache and shuts libcurl down. Handles still
+// held by other threads stay valid, the teardown happens when the last of them
+// is released.
+void http_share_shutdown(void);
+#endif // HTTP_SHARE_H
@@ -6,6 +6,7 @@
  */
 
 #include "auth.h"
+#include "http_share.h"
 #include "updater.h"
 #include <curl/curl.h>
 #include <gdk/gdk.h>
@@ -44,6 +45,29 @@ typedef struct {
   int exit_code;
 } GameExitCallbackData;
 
+/**
+ * @brief Inputs and results of a login running on a worker thread.
+ */
+typedef struct {
+  gchar *username;
+  gchar *password;
+  gboolean remember; /**< State of the "Remember Login?" checkbox. */
+  LoginData result;  /**< Filled in by do_login(). */
+} LoginTask;
+
+/**
+ * @brief Interval between progress bar frames while an update is running.
+ */
+#define PROGRESS_FRAME_INTERVAL_MS 33
+
+/**
+ * @brief Latest state of one progress bar, published by a worker thread.
+ */
+typedef struct {
+  double fraction;                      /**< Progress fraction to show. */
+  char message[FIXED_STRING_FIELD_SZ]; /**< Copy of the label to show. */
+} ProgressSnapshot;
+
 /**
  * @brief Structure to hold data for the update process.
  */
@@ -63,6 +87,9 @@ typedef struct {
   gboolean window_sensitive;
   gboolean wine_env_setup_done;
   gboolean wine_env_setup_success;
+  ProgressSnapshot *pending_progress;          /**< Swapped atomically. */
+  ProgressSnapshot *pending_download_progress; /**< Swapped atomically. */
+  gint progress_frame_scheduled; /**< Non-zero while a frame is queued. */
 } UpdateThreadData;
 
 /**
@@ -144,6 +171,18 @@ char torrent_file_name[FIXED_STRING_FIELD_SZ] = {0};
  */
 char torrent_magnet_link[FIXED_STRING_FIELD_SZ] = {0};
 
+/**
+ * @brief Torrent session profile shipped in the embedded json resource. Empty
+ * means libtorrent's own defaults.
+ */
+char torrent_profile_default_global[FIXED_STRING_FIELD_SZ] = {0};
+
+/**
+ * @brief Torrent session profile chosen in the launcher config INI, overriding
+ * torrent_profile_default_global when set.
+ */
+char torrent_profile_global[FIXED_STRING_FIELD_SZ] = {0};
+
 /**
  * @brief Holds a copy of the patch url root.
  */
@@ -222,6 +261,19 @@ bool plaintext_login_info_storage = false;
  */
 bool torrent_download_enabled = false;
 
+/**
+ * @brief If set to TRUE, the torrent is downloaded in order and the base game
+ * archive is extracted while it downloads instead of afterwards. This is
+ * configured at compile time from embedded JSON resource.
+ */
+bool torrent_stream_extract = false;
+
+/**
+ * @brief Number of cabinet downloads the updater keeps in flight at once.
+ * Configurable from the launcher config INI, clamped to a sane range on load.
+ */
+int max_concurrent_downloads = 8;
+
 /**
  * @brief Used to store the final update thread message, if any, to update
  * progress bar label when the update resources are being thrown out.
@@ -375,6 +427,8 @@ static void ut_data_unref(UpdateThreadData *td) {
   if (g_atomic_int_dec_and_test(&td->refcount)) {
     if (td->update_data.game_path)
       g_free(td->update_data.game_path);
+    g_free(td->pending_progress);
+    g_free(td->pending_download_progress);
     free(td);
   }
 }
@@ -406,17 +460,35 @@ static size_t write_callback(const void *contents, size_t size, size_t nmemb,
   return realsize;
 }
 
+/**
+ * @brief cURL progress callback that aborts the login request once its
+ * cancellable is triggered.
+ *
+ * @param clientp The GCancellable of the login.
+ * @return Non-zero to abort the transfer.
+ */
+static int login_xfer_cancel(void *clientp, curl_off_t dltotal,
+                             curl_off_t dlnow, curl_off_t ultotal,
+                             curl_off_t ulnow) {
+  (void)dltotal;
+  (void)dlnow;
+  (void)ultotal;
+  (void)ulnow;
+  return g_cancellable_is_cancelled(clientp) ? 1 : 0;
+}
+
 /**
  * @brief Performs the login operation by sending credentials to the server.
  *
  * @param username The user's login name.
  * @param password The user's password.
  * @param out Pointer to the LoginData structure to store results.
+ * @param cancellable Aborts the request when cancelled, may be NULL.
  * @return true if login is successful, false otherwise.
  */
 static bool do_login(const char *username, const char *password,
-                     LoginData *out) {
-  CURL *curl = curl_easy_init();
+                     LoginData *out, GCancellable *cancellable) {
+  CURL *curl = http_share_acquire();
   if (!curl) {
     g_warning("Failed to initialize cURL");
     return false;
@@ -454,6 +526,11 @@ static bool do_login(const char *username, const char *password,
   curl_easy_setopt(curl, CURLOPT_WRITEFUNCTION, write_callback);
   curl_easy_setopt(curl, CURLOPT_WRITEDATA, (void *)&chunk);
   curl_easy_setopt(curl, CURLOPT_TIMEOUT, 10L);
+  if (cancellable) {
+    curl_easy_setopt(curl, CURLOPT_NOPROGRESS, 0L);
+    curl_easy_setopt(curl, CURLOPT_XFERINFOFUNCTION, login_xfer_cancel);
+    curl_easy_setopt(curl, CURLOPT_XFERINFODATA, cancellable);
+  }
 
   // Perform the request
   CURLcode res = curl_easy_perform(curl);
@@ -512,7 +589,7 @@ static bool do_login(const char *username, const char *password,
   }
 
   // Clean up
-  curl_easy_cleanup(curl);
+  http_share_release(curl);
   curl_slist_free_all(headers);
   free(chunk.data);
 
@@ -675,6 +752,16 @@ static GtkWidget *create_login_overlay(LauncherData *ld) {
   gtk_widget_set_margin_end(ld->login_btn, 58);
   gtk_widget_add_css_class(ld->login_btn, "img_buttons");
 
+  // Spinner shown over the login button while a login is in flight.
+  ld->login_spinner = gtk_spinner_new();
+  gtk_widget_set_size_request(ld->login_spinner, 32, 32);
+  gtk_widget_set_halign(ld->login_spinner, GTK_ALIGN_CENTER);
+  gtk_widget_set_valign(ld->login_spinner, GTK_ALIGN_START);
+  gtk_widget_set_margin_top(ld->login_spinner, 258);
+  gtk_widget_set_can_target(ld->login_spinner, FALSE);
+  gtk_widget_set_visible(ld->login_spinner, FALSE);
+  gtk_overlay_add_overlay(GTK_OVERLAY(overlay), ld->login_spinner);
+
   // Close Button
   GdkTexture *close_tex =
       load_subimage("/com/tera/launcher/btn-close1.png", 0, 0, 22, 22);
@@ -1202,6 +1289,14 @@ static gboolean launcher_init_config(GtkApplication *app) {
   parse_and_copy_string(app, launcher_config_json, "torrent_payload_file_name",
                         torrent_file_name);
 
+  // Optional, older configs do not have it.
+  const json_t *torrent_profile =
+      json_object_get(launcher_config_json, "torrent_session_profile");
+  if (json_is_string(torrent_profile))
+    g_strlcpy(torrent_profile_default_global,
+              json_string_value(torrent_profile),
+              sizeof(torrent_profile_default_global));
+
   load_and_validate_path_setting(app, launcher_config_json, "wine_prefix_name",
                                  wineprefix_global, wineprefix_default_global);
   load_and_validate_path_setting(app, launcher_config_json, "game_prefix_name",
@@ -1225,6 +1320,12 @@ static gboolean launcher_init_config(GtkApplication *app) {
                                  ? torrent_download_enabled
                                  : false;
 
+  // Optional, older configs do not have it.
+  const json_t *stream_extract =
+      json_object_get(launcher_config_json, "torrent_stream_extract");
+  torrent_stream_extract =
+      json_is_boolean(stream_extract) && json_is_true(stream_extract);
+
   json_decref(launcher_config_json);
   return true;
 }
@@ -1242,18 +1343,21 @@ static gboolean progress_bar_callback(gpointer data) {
 }
 
 /**
- * @brief Callback function for marshalling progress bar updates on the GUI
- * @param data A pointer to an instance of update thread data.
- * @return Whether to kill the signal that fired this callback off or not.
+ * @brief Renders the download progress bar and applies the window state
+ * requested by the worker.
+ * @param td A pointer to an instance of update thread data.
+ * @param progress The progress fraction (0.0 to 1.0).
+ * @param message The message to display.
  */
-static gboolean download_progress_bar_callback(gpointer data) {
-  const UpdateThreadData *td = data;
+static void render_download_progress(const UpdateThreadData *td,
+                                     const double progress,
+                                     const char *message) {
   GtkProgressBar *pb = td->update_data.download_progress_bar;
   if (td->enable_pulse) {
     gtk_progress_bar_set_pulse_step(pb, 0.2);
     gtk_progress_bar_pulse(pb);
   } else {
-    gtk_progress_bar_set_fraction(pb, td->current_download_progress);
+    gtk_progress_bar_set_fraction(pb, progress);
   }
 
   GdkSurface *surface =
@@ -1273,17 +1377,91 @@ static gboolean download_progress_bar_callback(gpointer data) {
       gtk_window_present(GTK_WINDOW(td->ld->window));
   }
 
-  gtk_progress_bar_set_text(pb, td->current_download_message);
+  gtk_progress_bar_set_text(pb, message);
+}
+
+/**
+ * @brief Callback function for marshalling progress bar updates on the GUI
+ * @param data A pointer to an instance of update thread data.
+ * @return Whether to kill the signal that fired this callback off or not.
+ */
+static gboolean download_progress_bar_callback(gpointer data) {
+  const UpdateThreadData *td = data;
+  render_download_progress(td, td->current_download_progress,
+                           td->current_download_message);
   return FALSE;
 }
 
+/**
+ * @brief Applies one frame of progress published through the progress
+ * channel. Each bar is only touched if a new snapshot arrived since the last
+ * frame.
+ * @param td A pointer to an instance of update thread data.
+ */
+static void progress_channel_flush(UpdateThreadData *td) {
+  ProgressSnapshot *snap =
+      g_atomic_pointer_exchange(&td->pending_progress, nullptr);
+  if (snap) {
+    gtk_progress_bar_set_fraction(td->update_data.progress_bar,
+                                  snap->fraction);
+    gtk_progress_bar_set_text(td->update_data.progress_bar, snap->message);
+    g_free(snap);
+  }
+
+  snap = g_atomic_pointer_exchange(&td->pending_download_progress, nullptr);
+  if (snap) {
+    render_download_progress(td, snap->fraction, snap->message);
+    g_free(snap);
+  }
+}
+
+/**
+ * @brief Timer callback rendering a progress channel frame.
+ * @param data A pointer to an instance of update thread data.
+ * @return Whether to kill the signal that fired this callback off or not.
+ */
+static gboolean progress_channel_frame_callback(gpointer data) {
+  UpdateThreadData *td = data;
+  /* Clear the flag before draining so a snapshot published while we render
+     schedules the next frame instead of being stranded. */
+  g_atomic_int_set(&td->progress_frame_scheduled, 0);
+  progress_channel_flush(td);
+  return FALSE;
+}
+
+/**
+ * @brief Publishes the latest state of a progress bar from a worker thread.
+ * The message is copied, so callers may pass stack buffers. Snapshots that
+ * are superseded before the next frame are dropped, so the GUI cost is bounded
+ * by the frame rate rather than by how often workers report.
+ * @param td A pointer to an instance of update thread data.
+ * @param slot The pending snapshot slot of the bar to update.
+ * @param progress The progress fraction (0.0 to 1.0).
+ * @param message The message to display.
+ */
+static void progress_channel_publish(UpdateThreadData *td,
+                                     ProgressSnapshot **slot,
+                                     const double progress,
+                                     const char *message) {
+  const auto snap = g_new(ProgressSnapshot, 1);
+  snap->fraction = progress;
+  g_strlcpy(snap->message, message ? message : "", sizeof(snap->message));
+  g_free(g_atomic_pointer_exchange(slot, snap));
+
+  if (g_atomic_int_compare_and_exchange(&td->progress_frame_scheduled, 0, 1))
+    g_timeout_add_full(G_PRIORITY_HIGH_IDLE, PROGRESS_FRAME_INTERVAL_MS,
+                       progress_channel_frame_callback, ut_data_ref(td),
+                       (GDestroyNotify)ut_data_unref);
+}
+
 /**
  * @brief Used when we want to reset progress bar state after work is complete.
  * @param data A pointer to an instance of update thread data.
  * @return Whether to kill the signal that fired this callback off or not.
  */
 static gboolean progress_bar_final_callback(gpointer data) {
-  const UpdateThreadData *td = data;
+  UpdateThreadData *td = data;
+  progress_channel_flush(td);
   if (strlen(update_finish_message) != 0) {
     gtk_progress_bar_set_fraction(td->update_data.progress_bar, 1.0);
     gtk_progress_bar_set_text(td->update_data.progress_bar,
@@ -1303,7 +1481,8 @@ static gboolean progress_bar_final_callback(gpointer data) {
  * @return Whether to kill the signal that fired this callback off or not.
  */
 static gboolean progress_bar_final_torrent_callback(gpointer data) {
-  const UpdateThreadData *td = data;
+  UpdateThreadData *td = data;
+  progress_channel_flush(td);
   if (strlen(update_torrent_message) != 0) {
     gtk_progress_bar_set_fraction(td->update_data.progress_bar, 1.0);
     gtk_progress_bar_set_text(td->update_data.progress_bar,
@@ -1337,12 +1516,7 @@ static gboolean button_status_callback(gpointer data) {
 static void update_progress_callback(double progress, const char *message,
                                      gpointer user_data) {
   UpdateThreadData *td = user_data;
-  td->current_progress = progress;
-  td->current_message = message;
-
-  // Schedule the update in the main thread
-  g_idle_add_full(G_PRIORITY_HIGH_IDLE, progress_bar_callback, ut_data_ref(td),
-                  (GDestroyNotify)ut_data_unref);
+  progress_channel_publish(td, &td->pending_progress, progress, message);
 }
 
 /**
@@ -1356,12 +1530,8 @@ static void update_download_progress_callback(double progress,
                                               const char *message,
                                               gpointer user_data) {
   UpdateThreadData *td = user_data;
-  td->current_download_progress = progress;
-  td->current_download_message = message;
-
-  // Schedule the update in the main thread
-  g_idle_add_full(G_PRIORITY_HIGH_IDLE, download_progress_bar_callback,
-                  ut_data_ref(td), (GDestroyNotify)ut_data_unref);
+  progress_channel_publish(td, &td->pending_download_progress, progress,
+                           message);
 }
 
 // Thread function
@@ -1452,7 +1622,9 @@ static gpointer update_thread_func(gpointer data) {
   // Extract the game files payload if download was successful
   if (torrent_download_enabled && torrent_download_success) {
     g_warning("Attempting to extract base game files.");
-    if (extract_torrent_base_files(update_progress_callback,
+    // With streaming extraction the download already unpacked the archive.
+    if (torrent_stream_extract ||
+        extract_torrent_base_files(update_progress_callback,
                                    update_download_progress_callback,
                                    ut_data)) {
       strcpy(update_torrent_message, "Base game files extracted. Validating.");
@@ -1481,7 +1653,7 @@ static gpointer update_thread_func(gpointer data) {
       g_warning("Failed to download and extract torrent base game files.");
   }
 
-  GList *files_to_update;
+  Manifest *files_to_update;
   if (torrent_download_enabled && do_torrent_download) {
     files_to_update =
         get_files_to_repair(update_data, update_progress_callback, ut_data);
@@ -1514,13 +1686,13 @@ static gpointer update_thread_func(gpointer data) {
     ut_data->repair_button_enabled = TRUE;
     g_idle_add_full(G_PRIORITY_HIGH_IDLE, button_status_callback,
                     ut_data_ref(ut_data), (GDestroyNotify)ut_data_unref);
-    g_list_free_full(files_to_update, free_file_info);
+    manifest_free(files_to_update);
     ut_data_unref(ut_data);
     return nullptr;
   }
 
   // Cleanup
-  g_list_free_full(files_to_update, free_file_info);
+  manifest_free(files_to_update);
 
   // Re-enable play/repair buttons and cleanup the update thread data struct
   ut_data->play_button_enabled = TRUE;
@@ -2271,84 +2443,190 @@ static void on_play_clicked(GtkButton *btn, gpointer user_data) {
 static void switch_to_patch(LauncherData *ld);
 
 /**
- * @brief Callback function for handling login button clicks.
+ * @brief Frees a LoginTask.
  *
- * @param btn The login button widget.
+ * @param data Pointer to the LoginTask.
+ */
+static void login_task_free(gpointer data) {
+  LoginTask *lt = data;
+  g_free(lt->username);
+  g_free(lt->password);
+  g_free(lt);
+}
+
+/**
+ * @brief Greys out the login form and shows the spinner while a login is in
+ * flight, or restores the form afterwards.
+ *
+ * @param ld Pointer to LauncherData.
+ * @param busy TRUE while the login is running.
+ */
+static void set_login_busy(const LauncherData *ld, const gboolean busy) {
+  gtk_widget_set_sensitive(ld->login_btn, !busy);
+  gtk_widget_set_sensitive(ld->user_entry, !busy);
+  gtk_widget_set_sensitive(ld->pass_entry, !busy);
+  gtk_widget_set_sensitive(ld->login_store_checkbox, !busy);
+  gtk_widget_set_visible(ld->login_spinner, busy);
+  gtk_spinner_set_spinning(GTK_SPINNER(ld->login_spinner), busy);
+}
+
+/**
+ * @brief Worker thread half of a login. Performs the request and the keyring
+ * update, both of which block for a network or D-Bus round trip.
+ *
+ * @param task The GTask running the login.
+ * @param source_object Unused.
+ * @param task_data Pointer to the LoginTask.
+ * @param cancellable Aborts the request when the window is closed.
+ */
+static void login_thread_func(GTask *task, gpointer source_object,
+                              gpointer task_data, GCancellable *cancellable) {
+  (void)source_object;
+  LoginTask *lt = task_data;
+
+  if (!do_login(lt->username, lt->password, &lt->result, cancellable)) {
+    g_task_return_boolean(task, FALSE);
+    return;
+  }
+
+  if (!plaintext_login_info_storage) {
+    if (!lt->remember)
+      tl4l_clear_account_password(lt->username);
+    else if (!tl4l_store_account_password(lt->username, lt->password))
+      g_warning("Could not store password for account with username '%s'",
+                lt->username);
+  }
+  g_task_return_boolean(task, TRUE);
+}
+
+/**
+ * @brief Releases the updater and HTTP state and destroys the launcher window.
+ *
+ * @param ld Pointer to LauncherData.
+ */
+static void close_launcher(const LauncherData *ld) {
+  updater_shutdown();
+  http_share_shutdown();
+  gtk_window_destroy(GTK_WINDOW(ld->window));
+}
+
+/**
+ * @brief Main loop half of a login. Saves the login settings and switches to
+ * the patch pane on success, or tells the user the login failed.
+ *
+ * @param source_object Unused.
+ * @param res The GTask that ran the login.
  * @param user_data Pointer to LauncherData.
  */
-static void on_login_clicked(GtkButton *btn, gpointer user_data) {
+static void on_login_finished(GObject *source_object, GAsyncResult *res,
+                              gpointer user_data) {
+  (void)source_object;
   LauncherData *ld = user_data;
+  GTask *task = G_TASK(res);
+  const LoginTask *lt = g_task_get_task_data(task);
+
+  // Cancelled only by closing the window, which waited for us to finish.
+  const gboolean cancelled =
+      g_cancellable_is_cancelled(g_task_get_cancellable(task));
+  g_clear_object(&ld->login_cancellable);
+  const gboolean logged_in = g_task_propagate_boolean(task, nullptr);
+  if (cancelled) {
+    close_launcher(ld);
+    return;
+  }
+  set_login_busy(ld, FALSE);
 
-  const char *username = gtk_editable_get_text(GTK_EDITABLE(ld->user_entry));
-  const char *password = gtk_editable_get_text(GTK_EDITABLE(ld->pass_entry));
-  g_message("Attempting login for user=%s", username);
+  if (!logged_in) {
+    show_alert_dialog(
+        GTK_WINDOW(ld->window), "Login Failed",
+        "Login was not successful. Check your credentials and try again.",
+        ALERT_MSG_WARNING);
+    return;
+  }
 
-  LoginData temp = {0};
-  if (do_login(username, password, &temp)) {
-    size_t required;
-    bool success;
-    if (gtk_check_button_get_active(
-            GTK_CHECK_BUTTON(ld->login_store_checkbox))) {
-      save_login_info = true;
-      success =
-          str_copy_formatted(last_successful_login_username_global, &required,
-                             FIXED_STRING_FIELD_SZ, "%s", username);
-      if (success) {
-        if (!plaintext_login_info_storage) {
-          if (!tl4l_store_account_password(username, password))
-            g_warning("Could not store password for account with username '%s'",
-                      username);
-        } else {
-          success = str_copy_formatted(last_successful_login_password_global,
-                                       &required, FIXED_STRING_FIELD_SZ, "%s",
-                                       password);
-          if (!success)
-            g_warning("Could not store password for account with username '%s'",
-                      username);
-        }
-        config_write_to_ini();
-      } else {
-        g_error("Failed to allocate %zu bytes for username in buffer of "
-                "size %zu bytes.",
-                required, FIXED_STRING_FIELD_SZ);
+  size_t required;
+  bool success;
+  if (lt->remember) {
+    save_login_info = true;
+    success =
+        str_copy_formatted(last_successful_login_username_global, &required,
+                           FIXED_STRING_FIELD_SZ, "%s", lt->username);
+    if (success) {
+      if (plaintext_login_info_storage) {
+        success = str_copy_formatted(last_successful_login_password_global,
+                                     &required, FIXED_STRING_FIELD_SZ, "%s",
+                                     lt->password);
+        if (!success)
+          g_warning("Could not store password for account with username '%s'",
+                    lt->username);
       }
-    } else {
-      save_login_info = false;
-      memset(last_successful_login_username_global, 0, FIXED_STRING_FIELD_SZ);
-      if (!plaintext_login_info_storage)
-        tl4l_clear_account_password(username);
       config_write_to_ini();
-    }
-
-    // Store login data
-    strncpy(ld->login_data.user_no, temp.user_no,
-            sizeof(ld->login_data.user_no) - 1);
-    strncpy(ld->login_data.auth_key, temp.auth_key,
-            sizeof(ld->login_data.auth_key) - 1);
-    strncpy(ld->login_data.character_count, temp.character_count,
-            sizeof(ld->login_data.character_count) - 1);
-
-    // Prepare user welcome label on patch screen.
-    success = str_copy_formatted(ld->login_data.welcome_label_msg, &required,
-                                 FIXED_STRING_FIELD_SZ, "Welcome, <b>%s!</b>",
-                                 username);
-    if (!success) {
-      g_error("Failed to allocate %zu bytes for welcome string in buffer of "
+    } else {
+      g_error("Failed to allocate %zu bytes for username in buffer of "
               "size %zu bytes.",
               required, FIXED_STRING_FIELD_SZ);
     }
+  } else {
+    save_login_info = false;
+    memset(last_successful_login_username_global, 0, FIXED_STRING_FIELD_SZ);
+    config_write_to_ini();
+  }
 
-    gtk_label_set_markup(GTK_LABEL(ld->welcome_label),
-                         ld->login_data.welcome_label_msg);
+  // Store login data
+  strncpy(ld->login_data.user_no, lt->result.user_no,
+          sizeof(ld->login_data.user_no) - 1);
+  strncpy(ld->login_data.auth_key, lt->result.auth_key,
+          sizeof(ld->login_data.auth_key) - 1);
+  strncpy(ld->login_data.character_count, lt->result.character_count,
+          sizeof(ld->login_data.character_count) - 1);
 
-    g_message("Login success => switch to patch");
-    switch_to_patch(ld);
-  } else {
-    show_alert_dialog(
-        GTK_WINDOW(ld->window), "Login Failed",
-        "Login was not successful. Check your credentials and try again.",
-        ALERT_MSG_WARNING);
+  // Prepare user welcome label on patch screen.
+  success = str_copy_formatted(ld->login_data.welcome_label_msg, &required,
+                               FIXED_STRING_FIELD_SZ, "Welcome, <b>%s!</b>",
+                               lt->username);
+  if (!success) {
+    g_error("Failed to allocate %zu bytes for welcome string in buffer of "
+            "size %zu bytes.",
+            required, FIXED_STRING_FIELD_SZ);
   }
+
+  gtk_label_set_markup(GTK_LABEL(ld->welcome_label),
+                       ld->login_data.welcome_label_msg);
+
+  g_message("Login success => switch to patch");
+  switch_to_patch(ld);
+}
+
+/**
+ * @brief Callback function for handling login button clicks. Starts the
+ * login on a worker thread, on_login_finished() picks up the result.
+ *
+ * @param btn The login button widget.
+ * @param user_data Pointer to LauncherData.
+ */
+static void on_login_clicked(GtkButton *btn, gpointer user_data) {
+  (void)btn;
+  LauncherData *ld = user_data;
+  if (ld->login_cancellable)
+    return;
+
+  const auto lt = g_new0(LoginTask, 1);
+  lt->username =
+      g_strdup(gtk_editable_get_text(GTK_EDITABLE(ld->user_entry)));
+  lt->password =
+      g_strdup(gtk_editable_get_text(GTK_EDITABLE(ld->pass_entry)));
+  lt->remember =
+      gtk_check_button_get_active(GTK_CHECK_BUTTON(ld->login_store_checkbox));
+  g_message("Attempting login for user=%s", lt->username);
+
+  // The request runs on a worker thread so the window stays responsive.
+  ld->login_cancellable = g_cancellable_new();
+  GTask *task =
+      g_task_new(nullptr, ld->login_cancellable, on_login_finished, ld);
+  g_task_set_task_data(task, lt, login_task_free);
+  set_login_busy(ld, TRUE);
+  g_task_run_in_thread(task, login_thread_func);
+  g_object_unref(task);
 }
 
 /**
@@ -2395,8 +2673,14 @@ static void on_close_login_clicked(GtkButton *btn, gpointer user_data) {
   (void)btn;
   const LauncherData *ld = user_data;
   g_message("Close from login pane");
-  updater_shutdown();
-  gtk_window_destroy(GTK_WINDOW(ld->window));
+  if (ld->login_cancellable) {
+    // The worker still uses the shared HTTP handles, so on_login_finished()
+    // closes the launcher once the aborted request has returned.
+    g_cancellable_cancel(ld->login_cancellable);
+    gtk_widget_set_visible(ld->window, FALSE);
+    return;
+  }
+  close_launcher(ld);
 }
 
 /**
@@ -2409,8 +2693,7 @@ static void on_close_patch_clicked(GtkButton *btn, gpointer user_data) {
   (void)btn;
   const LauncherData *ld = user_data;
   g_message("Close from patch pane => destroy");
-  updater_shutdown();
-  gtk_window_destroy(GTK_WINDOW(ld->window));
+  close_launcher(ld);
 }
 
 /**
@@ -2575,6 +2858,7 @@ static void activate(GtkApplication *app, gpointer user_data) {
     g_error("Could not get style data from css");
   }
 
+  http_share_init();
   updater_init();
 
   // Create top-level window
@@ -765,6 +765,7 @@ void config_read_from_ini(void) {
   READ_STRING_KEY("wine_base_dir", wine_base_dir_global);
   READ_STRING_KEY("tera_toolbox_path", tera_toolbox_path_global);
   READ_STRING_KEY("gamescope_args", gamescope_args_global);
+  READ_STRING_KEY("torrent_session_profile", torrent_profile_global);
   READ_STRING_KEY("last_successful_login_username",
                   last_successful_login_username_global);
   READ_STRING_KEY("last_successful_login_password",
@@ -815,6 +816,15 @@ void config_read_from_ini(void) {
 
 #undef READ_BOOL_KEY
 
+  error = nullptr;
+  const gint concurrency = g_key_file_get_integer(
+      keyfile, "Settings", "max_concurrent_downloads", &error);
+  if (!error) {
+    max_concurrent_downloads = CLAMP(concurrency, 1, 64);
+  } else {
+    g_clear_error(&error);
+  }
+
   g_key_file_free(keyfile);
 }
 
@@ -855,6 +865,7 @@ void config_write_to_ini(void) {
   WRITE_STRING_KEY("gameprefix", gameprefix_global);
   WRITE_STRING_KEY("tera_toolbox_path", tera_toolbox_path_global);
   WRITE_STRING_KEY("gamescope_args", gamescope_args_global);
+  WRITE_STRING_KEY("torrent_session_profile", torrent_profile_global);
   WRITE_STRING_KEY("last_successful_login_username",
                    last_successful_login_username_global);
 #undef WRITE_STRING_KEY
@@ -874,6 +885,10 @@ void config_write_to_ini(void) {
   g_key_file_set_boolean(keyfile, "Settings", "save_login_info",
                          save_login_info);
 
+  // Write integer values (always written)
+  g_key_file_set_integer(keyfile, "Settings", "max_concurrent_downloads",
+                         max_concurrent_downloads);
+
   // Save to file
   gsize length = 0;
   gchar *data = g_key_file_to_data(keyfile, &length, nullptr);
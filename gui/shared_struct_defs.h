@@ -44,7 +44,9 @@ typedef struct {
   GtkWidget *pass_entry;
   GtkWidget *login_store_checkbox;
   GtkWidget *login_btn;
+  GtkWidget *login_spinner;
   GtkWidget *close_login_btn;
+  GCancellable *login_cancellable; // Set while a login is in flight
 
   // Patch/Play pane
   GtkWidget *patch_overlay;
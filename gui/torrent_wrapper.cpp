@@ -2,15 +2,44 @@
 #include <algorithm>
 #include <atomic>
 #include <chrono>
+#include <condition_variable>
+#include <cstdio>
+#include <fstream>
+#include <iterator>
 #include <libtorrent/add_torrent_params.hpp>
 #include <libtorrent/alert_types.hpp>
 #include <libtorrent/magnet_uri.hpp>
+#include <libtorrent/read_resume_data.hpp>
 #include <libtorrent/session.hpp>
 #include <libtorrent/settings_pack.hpp>
+#include <libtorrent/version.hpp>
+#include <libtorrent/write_resume_data.hpp>
+#include <memory>
+#include <mutex>
 #include <string>
 #include <thread>
 #include <vector>
 
+// How often torrent status updates are requested while downloading.
+static constexpr auto status_update_interval = std::chrono::milliseconds(500);
+
+// How long to wait for the metadata of a magnet link before giving up.
+static constexpr auto metadata_timeout = std::chrono::minutes(2);
+
+// How often resume data is saved while downloading.
+static constexpr auto resume_save_interval = std::chrono::minutes(1);
+
+// How long closing the session waits for the final resume data.
+static constexpr auto resume_save_timeout = std::chrono::seconds(10);
+
+// File inside the save path holding the resume data of the download.
+static constexpr const char *resume_file_name = ".tl4l-torrent.resume";
+
+// Alerts every session asks for. Sequential downloads add piece progress.
+static constexpr auto session_alert_mask = lt::alert_category::error |
+                                           lt::alert_category::storage |
+                                           lt::alert_category::status;
+
 struct TorrentSession {
   lt::session *session{nullptr};
   std::thread *thread{nullptr};
@@ -19,20 +48,239 @@ struct TorrentSession {
   std::atomic<bool> should_stop{false};
   std::string error_message{};
   lt::torrent_handle torrent_handle{};
+  std::string resume_path{};
+  std::string prepared_magnet{};    // Magnet added by get_total_size
+  std::string prepared_save_path{}; // Save path it was added with
+  std::mutex done_mutex{};
+  std::condition_variable done_cv{};
+  bool done{false};    // Guarded by done_mutex
+  bool success{false}; // Guarded by done_mutex
+  // Set by torrent_session_set_sequential(), all guarded by done_mutex.
+  std::shared_ptr<const lt::torrent_info> info{};
+  std::vector<bool> verified_pieces{};
+  int verified_prefix{0};       // Leading pieces that are all verified
+  uint64_t verified_bytes{0};   // Bytes covered by those pieces
+  std::vector<int> unflushed{}; // Verified, maybe still in the disk cache
+  std::vector<int> flushing{};  // Covered by the flush_cache() in flight
   TorrentSession() = default;
 };
 
-static void torrent_download_thread(TorrentSession *ts) {
+// Writes resume data, including the torrent metadata, next to the download.
+// The file is replaced atomically so a crash never leaves a torn copy.
+static void write_resume_file(const std::string &path,
+                              const lt::add_torrent_params &params) {
+  const std::vector<char> buf = lt::write_resume_data_buf(params);
+  const std::string tmp_path = path + ".tmp";
+  {
+    std::ofstream out(tmp_path, std::ios::binary | std::ios::trunc);
+    out.write(buf.data(), static_cast<std::streamsize>(buf.size()));
+    if (!out)
+      return;
+  }
+  std::rename(tmp_path.c_str(), path.c_str());
+}
+
+// Loads resume data saved by an earlier run. Returns false if there is none
+// or it cannot be parsed.
+static bool read_resume_file(const std::string &path,
+                             lt::add_torrent_params &params) {
+  std::ifstream in(path, std::ios::binary);
+  if (!in)
+    return false;
+  const std::vector<char> buf((std::istreambuf_iterator<char>(in)),
+                              std::istreambuf_iterator<char>());
+  lt::error_code ec;
+  params = lt::read_resume_data(buf, ec);
+  return !ec;
+}
+
+// Returns true if both parameter sets describe the same torrent.
+static bool same_torrent(const lt::add_torrent_params &a,
+                         const lt::add_torrent_params &b) {
+#if LIBTORRENT_VERSION_NUM >= 20000
+  return a.info_hashes == b.info_hashes;
+#else
+  return a.info_hash == b.info_hash;
+#endif
+}
+
+// Asks libtorrent for the current resume data and waits until it has been
+// written. Only used once the download thread has stopped, since this
+// consumes alerts itself.
+static void save_resume_now(TorrentSession *ts) {
   using namespace lt;
+  try {
+    ts->torrent_handle.save_resume_data(torrent_handle::save_info_dict);
+  } catch (const std::exception &) {
+    return; // The torrent was already removed after an error.
+  }
+  const auto deadline =
+      std::chrono::steady_clock::now() + resume_save_timeout;
   while (true) {
-    if (ts->should_stop.load())
-      break;
+    const auto now = std::chrono::steady_clock::now();
+    if (now >= deadline)
+      return;
+    ts->session->wait_for_alert(
+        std::chrono::duration_cast<lt::time_duration>(deadline - now));
+    std::vector<alert *> alerts;
+    ts->session->pop_alerts(&alerts);
+    for (alert *a : alerts) {
+      if (const auto rd = alert_cast<save_resume_data_alert>(a)) {
+        write_resume_file(ts->resume_path, rd->params);
+        return;
+      }
+      if (alert_cast<save_resume_data_failed_alert>(a))
+        return;
+    }
+  }
+}
+
+// Records the outcome of the download and wakes torrent_session_wait_done()
+// and torrent_session_wait_verified().
+static void torrent_download_finish(TorrentSession *ts, const bool success) {
+  {
+    std::lock_guard lock(ts->done_mutex);
+    if (ts->done)
+      return;
+    ts->done = true;
+    ts->success = success;
+    if (success && ts->info)
+      ts->verified_bytes = ts->info->total_size();
+  }
+  ts->done_cv.notify_all();
+}
+
+// Records that 'piece' passed its hash check. It only counts as verified once
+// a flush_cache() issued after this has completed, since the disk cache may
+// still hold its blocks and reading the file would return stale data.
+static void queue_piece_flush(TorrentSession *ts, const int piece) {
+  std::lock_guard lock(ts->done_mutex);
+  if (ts->info)
+    ts->unflushed.push_back(piece);
+}
+
+// Marks 'piece' verified and extends the verified prefix over it and any
+// pieces after it that were already verified. The caller holds done_mutex.
+// Returns true if the prefix grew.
+static bool mark_piece_verified(TorrentSession *ts, const int piece) {
+  const int num_pieces = static_cast<int>(ts->verified_pieces.size());
+  if (piece < 0 || piece >= num_pieces)
+    return false;
+  ts->verified_pieces[piece] = true;
+  const int old_prefix = ts->verified_prefix;
+  while (ts->verified_prefix < num_pieces &&
+         ts->verified_pieces[ts->verified_prefix])
+    ++ts->verified_prefix;
+  if (ts->verified_prefix == old_prefix)
+    return false;
+  ts->verified_bytes =
+      ts->verified_prefix == num_pieces
+          ? static_cast<uint64_t>(ts->info->total_size())
+          : static_cast<uint64_t>(ts->verified_prefix) *
+                static_cast<uint64_t>(ts->info->piece_length());
+  return true;
+}
+
+// Picks up pieces that were verified without a piece_finished_alert, such as
+// those restored from resume data and checked when the torrent was added.
+static void refresh_verified_pieces(TorrentSession *ts) {
+  using namespace lt;
+  torrent_status st;
+  try {
+    st = ts->torrent_handle.status(torrent_handle::query_pieces);
+  } catch (const std::exception &) {
+    return;
+  }
+  for (int i = 0; i < st.pieces.size(); ++i) {
+    if (st.pieces.get_bit(piece_index_t(i)))
+      queue_piece_flush(ts, i);
+  }
+}
+
+// Counts the pieces covered by a completed flush_cache() as verified.
+static void flush_completed(TorrentSession *ts) {
+  bool grew = false;
+  {
+    std::lock_guard lock(ts->done_mutex);
+    for (const int piece : ts->flushing)
+      grew = mark_piece_verified(ts, piece) || grew;
+    ts->flushing.clear();
+  }
+  if (grew)
+    ts->done_cv.notify_all();
+}
+
+// Starts a flush for every piece verified since the last one. Returns false
+// if there was nothing to flush.
+static bool flush_verified_pieces(TorrentSession *ts) {
+  {
+    std::lock_guard lock(ts->done_mutex);
+    if (ts->unflushed.empty())
+      return false;
+    ts->flushing.swap(ts->unflushed);
+  }
+  ts->torrent_handle.flush_cache();
+  return true;
+}
+
+// Reports the completed download and stops the download thread.
+static void torrent_download_complete(TorrentSession *ts) {
+  const lt::torrent_status s = ts->torrent_handle.status();
+  if (ts->progress_cb) {
+    ts->progress_cb(100.0f, s.total_wanted_done, s.total_wanted, 0,
+                    ts->progress_userdata);
+  }
+  // The archive is extracted and removed next, so resume data would
+  // only point at files that are about to disappear.
+  std::remove(ts->resume_path.c_str());
+  ts->should_stop.store(true);
+  torrent_download_finish(ts, true);
+}
+
+static void torrent_download_thread(TorrentSession *ts) {
+  using namespace lt;
+  auto next_update = std::chrono::steady_clock::now();
+  auto next_save = next_update + resume_save_interval;
+  int flushes_outstanding = 0; // flush_cache() calls without their alert yet
+  bool finishing = false;      // Finished, waiting for the final flush
+  while (!ts->should_stop.load()) {
+    // Sleep until libtorrent has something to say or the next status update
+    // is due, so completion and errors are seen as soon as they happen.
+    const auto now = std::chrono::steady_clock::now();
+    if (now >= next_update) {
+      ts->session->post_torrent_updates();
+      next_update = now + status_update_interval;
+    }
+    if (now >= next_save && ts->torrent_handle.is_valid()) {
+      ts->torrent_handle.save_resume_data(torrent_handle::save_info_dict);
+      next_save = now + resume_save_interval;
+    }
+    ts->session->wait_for_alert(
+        std::chrono::duration_cast<lt::time_duration>(next_update - now));
+
     std::vector<alert *> alerts;
     ts->session->pop_alerts(&alerts);
     for (alert *a : alerts) {
       if (const auto at = alert_cast<add_torrent_alert>(a)) {
         ts->torrent_handle = at->handle;
       }
+      if (const auto rd = alert_cast<save_resume_data_alert>(a)) {
+        write_resume_file(ts->resume_path, rd->params);
+      }
+      if (const auto pf = alert_cast<piece_finished_alert>(a)) {
+        queue_piece_flush(ts, static_cast<int>(pf->piece_index));
+      }
+      if (alert_cast<cache_flushed_alert>(a) && flushes_outstanding > 0) {
+        --flushes_outstanding;
+        flush_completed(ts);
+        if (finishing && flushes_outstanding == 0) {
+          torrent_download_complete(ts);
+          break;
+        }
+      }
+      if (alert_cast<torrent_checked_alert>(a)) {
+        refresh_verified_pieces(ts);
+      }
       if (const auto st = alert_cast<state_update_alert>(a)) {
         if (!st->status.empty()) {
           const torrent_status &s = st->status[0];
@@ -47,13 +295,19 @@ static void torrent_download_thread(TorrentSession *ts) {
         }
       }
       if (alert_cast<torrent_finished_alert>(a)) {
-        torrent_status s = ts->torrent_handle.status();
-        if (ts->progress_cb) {
-          ts->progress_cb(100.0f, s.total_wanted_done, s.total_wanted, 0,
-                          ts->progress_userdata);
+        bool streaming;
+        {
+          std::lock_guard lock(ts->done_mutex);
+          streaming = ts->info != nullptr;
         }
-        ts->should_stop.store(true);
-        break;
+        if (!streaming) {
+          torrent_download_complete(ts);
+          break;
+        }
+        // A reader of the file must see every byte once this reports done.
+        ts->torrent_handle.flush_cache();
+        ++flushes_outstanding;
+        finishing = true;
       }
       if (const auto te = alert_cast<torrent_error_alert>(a)) {
         ts->error_message = te->error.message().empty()
@@ -66,22 +320,108 @@ static void torrent_download_thread(TorrentSession *ts) {
           ts->session->remove_torrent(ts->torrent_handle);
         }
         ts->should_stop.store(true);
+        torrent_download_finish(ts, false);
         break;
       }
     }
-    std::this_thread::sleep_for(std::chrono::milliseconds(500));
-    ts->session->post_torrent_updates();
+    if (!ts->should_stop.load() && !finishing && flushes_outstanding == 0 &&
+        flush_verified_pieces(ts))
+      ++flushes_outstanding;
+  }
+  // Stopped by torrent_session_close() before the download ended.
+  torrent_download_finish(ts, false);
+}
+
+int torrent_session_profile_lookup(const char *name,
+                                   TorrentSessionProfile *profile) {
+  using namespace lt;
+  const settings_pack defaults = default_settings();
+  profile->connections_limit =
+      defaults.get_int(settings_pack::connections_limit);
+  profile->connection_speed = defaults.get_int(settings_pack::connection_speed);
+  profile->aio_threads = defaults.get_int(settings_pack::aio_threads);
+#if LIBTORRENT_VERSION_NUM >= 20000
+  profile->hashing_threads = defaults.get_int(settings_pack::hashing_threads);
+#else
+  profile->hashing_threads = 0;
+#endif
+  profile->send_buffer_low_watermark_kib =
+      defaults.get_int(settings_pack::send_buffer_low_watermark) / 1024;
+  profile->send_buffer_watermark_kib =
+      defaults.get_int(settings_pack::send_buffer_watermark) / 1024;
+  profile->max_queued_disk_kib =
+      defaults.get_int(settings_pack::max_queued_disk_bytes) / 1024;
+  profile->max_out_request_queue =
+      defaults.get_int(settings_pack::max_out_request_queue);
+  profile->request_queue_time =
+      defaults.get_int(settings_pack::request_queue_time);
+  profile->whole_pieces_threshold =
+      defaults.get_int(settings_pack::whole_pieces_threshold);
+  profile->piece_extent_affinity =
+      defaults.get_bool(settings_pack::piece_extent_affinity);
+  profile->strict_end_game_mode =
+      defaults.get_bool(settings_pack::strict_end_game_mode);
+
+  const std::string profile_name = name ? name : "";
+  if (profile_name.empty() || profile_name == "default")
+    return 0;
+  if (profile_name == "high_throughput") {
+    // Many peers and deep request queues keep a fast link busy, larger disk
+    // queues and more I/O and hashing threads keep the disk from throttling
+    // the peers, and extent affinity keeps writes mostly sequential.
+    profile->connections_limit = 500;
+    profile->connection_speed = 100;
+    profile->aio_threads = 8;
+    profile->hashing_threads = 4;
+    profile->send_buffer_low_watermark_kib = 1024;
+    profile->send_buffer_watermark_kib = 3 * 1024;
+    profile->max_queued_disk_kib = 64 * 1024;
+    profile->max_out_request_queue = 1500;
+    profile->request_queue_time = 5;
+    profile->whole_pieces_threshold = 5;
+    profile->piece_extent_affinity = 1;
+    profile->strict_end_game_mode = 0;
+    return 0;
   }
+  return -1;
+}
+
+// Applies a session profile on top of the settings in 'pack'.
+static void apply_profile(lt::settings_pack &pack,
+                          const TorrentSessionProfile &profile) {
+  using namespace lt;
+  pack.set_int(settings_pack::connections_limit, profile.connections_limit);
+  pack.set_int(settings_pack::connection_speed, profile.connection_speed);
+  pack.set_int(settings_pack::aio_threads, profile.aio_threads);
+#if LIBTORRENT_VERSION_NUM >= 20000
+  pack.set_int(settings_pack::hashing_threads, profile.hashing_threads);
+#endif
+  pack.set_int(settings_pack::send_buffer_low_watermark,
+               profile.send_buffer_low_watermark_kib * 1024);
+  pack.set_int(settings_pack::send_buffer_watermark,
+               profile.send_buffer_watermark_kib * 1024);
+  pack.set_int(settings_pack::max_queued_disk_bytes,
+               profile.max_queued_disk_kib * 1024);
+  pack.set_int(settings_pack::max_out_request_queue,
+               profile.max_out_request_queue);
+  pack.set_int(settings_pack::request_queue_time, profile.request_queue_time);
+  pack.set_int(settings_pack::whole_pieces_threshold,
+               profile.whole_pieces_threshold);
+  pack.set_bool(settings_pack::piece_extent_affinity,
+                profile.piece_extent_affinity != 0);
+  pack.set_bool(settings_pack::strict_end_game_mode,
+                profile.strict_end_game_mode != 0);
 }
 
 TorrentSession *torrent_session_create(const TorrentProgressCallback progress_cb,
-                                       void *userdata) {
+                                       void *userdata,
+                                       const TorrentSessionProfile *profile) {
   using namespace lt;
   try {
     settings_pack pack = default_settings();
-    pack.set_int(settings_pack::alert_mask, alert_category::error |
-                                                alert_category::storage |
-                                                alert_category::status);
+    if (profile)
+      apply_profile(pack, *profile);
+    pack.set_int(settings_pack::alert_mask, session_alert_mask);
     pack.set_str(settings_pack::listen_interfaces, "0.0.0.0:0,[::]:0");
     auto ses = std::make_unique<session>(pack);
     auto *ts = new TorrentSession();
@@ -94,6 +434,32 @@ TorrentSession *torrent_session_create(const TorrentProgressCallback progress_cb
   }
 }
 
+// Builds the parameters for adding the torrent behind 'magnet_link' to
+// 'save_path'. If an earlier run left resume data for the same torrent, that
+// is used instead, so the metadata and the pieces it already verified need not
+// be fetched or checked again.
+static bool torrent_params_load(TorrentSession *session,
+                                const char *magnet_link, const char *save_path,
+                                lt::add_torrent_params &params) {
+  lt::error_code ec;
+  params = lt::parse_magnet_uri(magnet_link, ec);
+  if (ec) {
+    session->error_message =
+        ec.message().empty() ? "Failed to parse magnet link" : ec.message();
+    return false;
+  }
+  params.save_path = save_path;
+
+  session->resume_path = std::string(save_path) + "/" + resume_file_name;
+  lt::add_torrent_params resume;
+  if (read_resume_file(session->resume_path, resume) &&
+      same_torrent(resume, params)) {
+    resume.save_path = save_path;
+    params = std::move(resume);
+  }
+  return true;
+}
+
 int torrent_session_start_download(TorrentSession *session,
                                    const char *magnet_link,
                                    const char *save_path) {
@@ -101,20 +467,31 @@ int torrent_session_start_download(TorrentSession *session,
     return -1;
   session->error_message.clear();
   using namespace lt;
-  error_code ec;
-  auto params = parse_magnet_uri(magnet_link, ec);
-  if (ec) {
-    session->error_message =
-        ec.message().empty() ? "Failed to parse magnet link" : ec.message();
-    return -1;
-  }
-  params.save_path = save_path;
-  try {
-    session->torrent_handle = session->session->add_torrent(std::move(params));
-  } catch (const std::exception &e) {
-    session->error_message = e.what();
-    return -1;
+
+  if (session->torrent_handle.is_valid() &&
+      session->prepared_magnet == magnet_link &&
+      session->prepared_save_path == save_path) {
+    // Already added with its metadata by torrent_session_get_total_size().
+    try {
+      session->torrent_handle.set_flags(torrent_flags::auto_managed);
+      session->torrent_handle.resume();
+    } catch (const std::exception &e) {
+      session->error_message = e.what();
+      return -1;
+    }
+  } else {
+    add_torrent_params params;
+    if (!torrent_params_load(session, magnet_link, save_path, params))
+      return -1;
+    try {
+      session->torrent_handle =
+          session->session->add_torrent(std::move(params));
+    } catch (const std::exception &e) {
+      session->error_message = e.what();
+      return -1;
+    }
   }
+
   try {
     session->thread = new std::thread(torrent_download_thread, session);
   } catch (...) {
@@ -130,19 +507,22 @@ int torrent_session_start_download(TorrentSession *session,
 
 int torrent_session_get_total_size(TorrentSession *session,
                                    const char *magnet_link,
-                                   uint64_t *size_out) {
-  if (!session || !magnet_link || !size_out)
+                                   const char *save_path, uint64_t *size_out) {
+  if (!session || !magnet_link || !save_path || !size_out)
     return -1;
   session->error_message.clear();
   using namespace lt;
-  error_code ec;
-  auto params = parse_magnet_uri(magnet_link, ec);
-  if (ec) {
-    session->error_message =
-        ec.message().empty() ? "Failed to parse magnet link" : ec.message();
+  add_torrent_params params;
+  if (!torrent_params_load(session, magnet_link, save_path, params))
     return -1;
-  }
-  params.save_path = ".";
+
+  // The torrent stays in the session so torrent_session_start_download() can
+  // reuse it. It is held paused until then, and if the metadata was cached by
+  // an earlier run it is never started here at all.
+  const auto ti = params.ti;
+  params.flags &= ~torrent_flags::auto_managed;
+  if (ti)
+    params.flags |= torrent_flags::paused;
   torrent_handle th;
   try {
     th = session->session->add_torrent(std::move(params));
@@ -150,37 +530,109 @@ int torrent_session_get_total_size(TorrentSession *session,
     session->error_message = e.what();
     return -1;
   }
-  // wait for metadata or error
-  while (true) {
-    std::vector<alert *> alerts;
-    session->session->pop_alerts(&alerts);
+
+  if (ti) {
+    size_out[0] = ti->total_size();
+  } else {
+    // wait for metadata or error
+    const auto deadline = std::chrono::steady_clock::now() + metadata_timeout;
     bool got = false;
-    for (alert *a : alerts) {
-      if (const auto md = alert_cast<metadata_received_alert>(a)) {
-        if (md->handle == th) {
-          size_out[0] = md->handle.torrent_file()->total_size();
-          got = true;
-          break;
-        }
+    while (!got) {
+      const auto now = std::chrono::steady_clock::now();
+      if (now >= deadline) {
+        session->error_message = "Timed out waiting for torrent metadata";
+        session->session->remove_torrent(th);
+        return -1;
       }
-      if (const auto te = alert_cast<torrent_error_alert>(a)) {
-        if (te->handle == th) {
-          session->error_message = te->error.message().empty()
-                                       ? "Unknown torrent error"
-                                       : te->error.message();
-          session->session->remove_torrent(th);
-          return -1;
+      session->session->wait_for_alert(
+          std::chrono::duration_cast<lt::time_duration>(deadline - now));
+      std::vector<alert *> alerts;
+      session->session->pop_alerts(&alerts);
+      for (alert *a : alerts) {
+        if (const auto md = alert_cast<metadata_received_alert>(a)) {
+          if (md->handle == th) {
+            size_out[0] = md->handle.torrent_file()->total_size();
+            got = true;
+            break;
+          }
+        }
+        if (const auto te = alert_cast<torrent_error_alert>(a)) {
+          if (te->handle == th) {
+            session->error_message = te->error.message().empty()
+                                         ? "Unknown torrent error"
+                                         : te->error.message();
+            session->session->remove_torrent(th);
+            return -1;
+          }
         }
       }
     }
-    if (got)
-      break;
-    std::this_thread::sleep_for(std::chrono::milliseconds(100));
+    th.pause();
+    // Cache the info-dict right away so later runs skip this wait.
+    th.save_resume_data(torrent_handle::save_info_dict);
+  }
+
+  session->torrent_handle = th;
+  session->prepared_magnet = magnet_link;
+  session->prepared_save_path = save_path;
+  return 0;
+}
+
+int torrent_session_wait_done(TorrentSession *session) {
+  if (!session || !session->thread)
+    return -1;
+  std::unique_lock lock(session->done_mutex);
+  session->done_cv.wait(lock, [session] { return session->done; });
+  return session->success ? 0 : -1;
+}
+
+int torrent_session_set_sequential(TorrentSession *session) {
+  if (!session || !session->torrent_handle.is_valid())
+    return -1;
+  session->error_message.clear();
+  using namespace lt;
+  const auto info = session->torrent_handle.torrent_file();
+  if (!info) {
+    session->error_message = "Torrent metadata is not available yet";
+    return -1;
+  }
+  try {
+    settings_pack pack;
+    pack.set_int(settings_pack::alert_mask,
+                 session_alert_mask | alert_category::piece_progress);
+    session->session->apply_settings(pack);
+    session->torrent_handle.set_flags(torrent_flags::sequential_download);
+  } catch (const std::exception &e) {
+    session->error_message = e.what();
+    return -1;
   }
-  session->session->remove_torrent(th);
+  {
+    std::lock_guard lock(session->done_mutex);
+    session->info = info;
+    session->verified_pieces.assign(info->num_pieces(), false);
+    session->verified_prefix = 0;
+    // The download may have completed from resume data before this call.
+    session->verified_bytes =
+        session->done && session->success ? info->total_size() : 0;
+  }
+  refresh_verified_pieces(session);
   return 0;
 }
 
+int torrent_session_wait_verified(TorrentSession *session, const uint64_t have,
+                                  uint64_t *available) {
+  if (!session || !session->thread || !available)
+    return -1;
+  std::unique_lock lock(session->done_mutex);
+  session->done_cv.wait(lock, [session, have] {
+    return session->done || session->verified_bytes > have;
+  });
+  available[0] = session->verified_bytes;
+  if (!session->done)
+    return 0;
+  return session->success ? 1 : -1;
+}
+
 void torrent_session_close(TorrentSession *session) {
   if (!session)
     return;
@@ -191,6 +643,8 @@ void torrent_session_close(TorrentSession *session) {
     session->thread = nullptr;
   }
   if (session->torrent_handle.is_valid()) {
+    if (!session->success && !session->resume_path.empty())
+      save_resume_now(session);
     session->session->remove_torrent(session->torrent_handle);
   }
   session->session->abort();
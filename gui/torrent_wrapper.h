@@ -36,6 +36,40 @@ typedef void (*TorrentProgressCallback)(float progress, uint64_t downloaded,
                                         uint64_t total, uint32_t download_rate,
                                         void *userdata);
 
+/**
+ * @struct TorrentSessionProfile
+ * @brief Tunables applied to the libtorrent session. Sizes are in KiB.
+ */
+typedef struct {
+  int connections_limit;    /**< Peer connections across the session. */
+  int connection_speed;     /**< New connection attempts per second. */
+  int aio_threads;          /**< Threads doing disk I/O. */
+  int hashing_threads;      /**< Threads verifying pieces (libtorrent 2.0+). */
+  int send_buffer_low_watermark_kib; /**< Refill send buffers below this. */
+  int send_buffer_watermark_kib;     /**< Upper bound of send buffers. */
+  int max_queued_disk_kib;  /**< Received data allowed to wait for disk. */
+  int max_out_request_queue; /**< Outstanding block requests per peer. */
+  int request_queue_time;   /**< Seconds of requests queued per peer. */
+  int whole_pieces_threshold; /**< Seconds per piece to get whole pieces. */
+  int piece_extent_affinity; /**< Non-zero to prefer pieces near in-flight. */
+  int strict_end_game_mode; /**< Non-zero to only double-request at the end. */
+} TorrentSessionProfile;
+
+/**
+ * @brief Fill in a named session profile.
+ *
+ * "default" (or an empty name) yields libtorrent's desktop defaults.
+ * "high_throughput" is tuned for pulling a single very large torrent as fast
+ * as the link allows.
+ *
+ * @param name    Null-terminated profile name.
+ * @param profile Receives the profile settings.
+ * @return 0 on success, or -1 if the name is unknown (profile then holds the
+ *         defaults).
+ */
+int torrent_session_profile_lookup(const char *name,
+                                   TorrentSessionProfile *profile);
+
 /**
  * @brief Create and configure a new torrent session.
  *
@@ -44,17 +78,21 @@ typedef void (*TorrentProgressCallback)(float progress, uint64_t downloaded,
  *
  * @param progress_cb Function pointer to receive progress updates.
  * @param userdata    Pointer to user-defined context for the callback.
+ * @param profile     Session tunables, or NULL for libtorrent's defaults.
  * @return Pointer to a new TorrentSession on success, or NULL on failure.
  */
 TorrentSession *torrent_session_create(TorrentProgressCallback progress_cb,
-                                       void *userdata);
+                                       void *userdata,
+                                       const TorrentSessionProfile *profile);
 
 /**
  * @brief Start downloading a torrent from a magnet link.
  *
  * Parses the provided magnet URI and begins downloading files to the
  * specified save directory. Progress is reported asynchronously via the
- * callback provided in torrent_session_create().
+ * callback provided in torrent_session_create(). Resume data is kept in the
+ * save directory while downloading and when the session is closed, and a
+ * later download of the same torrent continues from it.
  *
  * @param session     Pointer to a valid TorrentSession.
  * @param magnet_link Null-terminated string containing the magnet URI.
@@ -70,17 +108,67 @@ int torrent_session_start_download(TorrentSession *session,
  * @brief Retrieve the total size of the torrent contents (in bytes) by fetching
  * metadata.
  *
- * Parses the magnet URI, fetches metadata (blocking), and returns the total
- * content size.
+ * Parses the magnet URI, fetches metadata (blocking for up to two minutes),
+ * and returns the total content size. Metadata cached in the save directory by
+ * an earlier run is used without touching the network. The torrent is kept
+ * paused in the session, and a following torrent_session_start_download() for
+ * the same magnet link and save directory reuses it.
  *
  * @param session     Pointer to a valid TorrentSession.
  * @param magnet_link Null-terminated string containing the magnet URI.
+ * @param save_path   Null-terminated string specifying the download folder.
  * @param size_out    Pointer to uint64_t to receive the total size in bytes.
  * @return 0 on success, or -1 on error. Check torrent_session_get_error() for
  * details on failure.
  */
 int torrent_session_get_total_size(TorrentSession *session,
-                                   const char *magnet_link, uint64_t *size_out);
+                                   const char *magnet_link,
+                                   const char *save_path, uint64_t *size_out);
+
+/**
+ * @brief Wait for the download started by torrent_session_start_download().
+ *
+ * Blocks the calling thread on a condition variable until the torrent has
+ * finished, failed, or the session was closed from another thread. Returns as
+ * soon as the download thread sees the outcome, without polling.
+ *
+ * @param session Pointer to a valid TorrentSession with a started download.
+ * @return 0 if the download completed, or -1 on error. Check
+ *         torrent_session_get_error() for details on failure.
+ */
+int torrent_session_wait_done(TorrentSession *session);
+
+/**
+ * @brief Download the pieces of a started torrent in order.
+ *
+ * Switches the torrent to sequential download and starts tracking which of its
+ * pieces have passed the hash check and been flushed from the disk cache to the
+ * file, so torrent_session_wait_verified() can report how much of the data from
+ * its start may be read. Pieces verified
+ * before this call, including those restored from resume data, are counted.
+ *
+ * @param session Pointer to a valid TorrentSession whose torrent has metadata.
+ * @return 0 on success, or -1 on error. Check torrent_session_get_error() for
+ *         details on failure.
+ */
+int torrent_session_set_sequential(TorrentSession *session);
+
+/**
+ * @brief Wait for more verified data at the start of the torrent.
+ *
+ * Blocks until the run of verified pieces at the start of the torrent covers
+ * more than @p have bytes, or the download has ended. Requires
+ * torrent_session_set_sequential().
+ *
+ * @param session   Pointer to a valid TorrentSession with a started download.
+ * @param have      Number of bytes the caller has already consumed.
+ * @param available Pointer to uint64_t to receive the number of bytes, counted
+ *                  from the start of the torrent, that are verified on disk.
+ * @return 0 if the download is still running, 1 once it completed and all data
+ *         is verified, or -1 if it failed.
+ */
+int torrent_session_wait_verified(TorrentSession *session, uint64_t have,
+                                  uint64_t *available);
 
 /**
  * @brief Close and clean up a torrent session.
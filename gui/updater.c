@@ -7,22 +7,25 @@
 
 #include "updater.h"
 #include "globals.h"
+#include "http_share.h"
 #include "util.h"
 #include <curl/curl.h>
+#include <errno.h>
+#include <fcntl.h>
 #include <gio/gio.h>
 #include <glib.h>
+#include <lzma.h>
+#include <pthread.h>
+#include <signal.h>
 #include <sqlite3.h>
 #include <stdlib.h>
 #include <sys/stat.h>
 #include <sys/time.h>
+#include <sys/wait.h>
 #include <unistd.h>
 
 /* --- CONSTANTS --- */
 
-/* We use our own handle to avoid competing with other threads for access to it
- */
-static CURL *curl = nullptr;
-
 /* Current game version parsed from version.ini */
 static gint current_version = 0;
 
@@ -43,30 +46,10 @@ static gchar *patch_path = nullptr;
 static const gchar *sql_generate_update_manifest = nullptr;
 static GBytes *generate_update_manifest_gbytes = nullptr;
 
-/* SQL query to generate the update manifest.
-   Note: The @current_version placeholder is bound in the code. */
-static const gchar *sql_generate_update_manifest_sz = nullptr;
-static GBytes *generate_update_manifest_sz_gbytes = nullptr;
-
 /* SQL query to generate a full file manifest (used for repair operations) */
 static const gchar *sql_generate_full_manifest = nullptr;
 static GBytes *generate_full_file_manifest_gbytes = nullptr;
 
-/* SQL query to get a count of records for the query above (used to report
- * progress during repair operations) */
-static const gchar *sql_generate_full_manifest_count = nullptr;
-static GBytes *generate_full_file_manifest_count_gbytes = nullptr;
-
-/* SQL query to generate filesystem directory tree (used for repair operations)
- */
-static const gchar *sql_generate_file_paths = nullptr;
-static GBytes *generate_file_paths_gbytes = nullptr;
-
-/* SQL query to get a count of records for the query above (used to report
- * progress during directory tree build operations) */
-static const gchar *sql_generate_file_paths_count = nullptr;
-static GBytes *generate_file_paths_count_gbytes = nullptr;
-
 /* Used by curl to report download data rates to the progress bar label */
 typedef struct {
   ProgressCallback callback;
@@ -79,9 +62,8 @@ typedef struct {
   char download_now[FIXED_STRING_FIELD_SZ];
   char download_total[FIXED_STRING_FIELD_SZ];
   char download_speed[FIXED_STRING_FIELD_SZ];
+  CURL *easy;
   TorrentSession *session;
-  bool torrent_download_done;
-  bool torrent_download_success;
 } ProgressData;
 
 /**
@@ -102,6 +84,199 @@ typedef struct ExtractData {
   guint child_watch_id;    /**< Watch ID for child‑exit. */
 } ExtractData;
 
+/* Size of the read buffer used while hashing existing game files */
+#define HASH_READ_CHUNK_SZ (1024 * 1024)
+
+/* Amount of hashed data after which its pages are dropped from the cache */
+#define HASH_DROP_CACHE_SZ (8 * 1024 * 1024)
+
+/* Size of the read and write buffers used while decoding cabinets */
+#define CABINET_IO_CHUNK_SZ (128 * 1024)
+
+/* Hidden directory inside the game prefix where cabinets are decoded before
+   being renamed into place. Keeping it on the same filesystem as the game
+   files makes each install a metadata-only rename instead of a copy. */
+#define STAGING_DIR_NAME ".tl4l-staging"
+
+/**
+ * @brief Streaming decoder for the easylzma cabinets served by the patch
+ * server. Cabinets are plain LZMA-alone streams, so liblzma decodes them
+ * in-process without spawning unelzma.
+ */
+typedef struct {
+  lzma_stream strm;                   /**< liblzma decoder state. */
+  FILE *out;                          /**< Destination for decoded data. */
+  GChecksum *md5;                     /**< Optional hash of decoded data. */
+  guint64 written;                    /**< Decoded bytes written so far. */
+  gboolean finished;                  /**< TRUE once the stream has ended. */
+  guint8 out_buf[CABINET_IO_CHUNK_SZ]; /**< Decoder output buffer. */
+} CabinetDecoder;
+
+/* File name of the local install ledger */
+#define INSTALL_LEDGER_NAME "install-ledger.db"
+#define LEDGER_CHECKPOINT_INTERVAL_US (2 * G_USEC_PER_SEC)
+
+/* File name of the marker recording the last version fully installed */
+#define INSTALL_MARKER_NAME "install-complete"
+
+/* File name of the HTTP validator cache for version.ini and server.db */
+#define HTTP_CACHE_NAME "http-cache.ini"
+
+/* Upper bound for the exponential back-off between download retries */
+#define RETRY_BACKOFF_CAP_MS (60 * 1000)
+
+/* Number of transfers the download engine starts out with */
+#define ENGINE_INITIAL_WINDOW 2
+
+/* How often the download engine re-evaluates its transfer window */
+#define ENGINE_WINDOW_PERIOD_S 2.0
+
+/* Throughput gain over the previous period needed to widen the window */
+#define ENGINE_WINDOW_GAIN 1.05
+
+/* A transfer slower than 1 byte/s for this long is treated as stalled */
+#define ENGINE_STALL_TIMEOUT_S 30L
+
+/**
+ * @brief HTTP cache validators of a downloaded resource. Sent as conditions
+ * with a request and updated from its response.
+ */
+typedef struct {
+  char etag[FIXED_STRING_FIELD_SZ];          /**< ETag, empty if unknown. */
+  char last_modified[FIXED_STRING_FIELD_SZ]; /**< Last-Modified, or empty. */
+  gboolean not_modified; /**< TRUE if the server answered 304. */
+} HttpValidators;
+
+/**
+ * @brief Stat tuple and verified hash of an installed file, as recorded in
+ * the local install ledger.
+ */
+typedef struct {
+  gint64 size;     /**< File size when it was verified. */
+  gint64 mtime_ns; /**< Modification time when it was verified. */
+  guint64 inode;   /**< Inode number when it was verified. */
+  gint version;    /**< Manifest version the file was verified against. */
+  char hash[33];   /**< Verified MD5 of the file. */
+} LedgerRecord;
+
+/**
+ * @brief Open handle on the local install ledger, which remembers files that
+ * were already verified so unchanged files need not be hashed again.
+ */
+typedef struct {
+  sqlite3 *db;           /**< Ledger database, nullptr if unavailable. */
+  sqlite3_stmt *upsert;  /**< Cached statement used by ledger_record(). */
+  gint64 last_commit;    /**< Monotonic time of the last commit. */
+} InstallLedger;
+
+/* Stamped into PRAGMA user_version once the server database has been given
+   the indexes below, so an unchanged database is not indexed again. */
+#define SERVER_DB_INDEX_VERSION 1
+
+/* How much of the server database SQLite may map into memory */
+#define SERVER_DB_MMAP_SZ (256 * 1024 * 1024)
+
+/**
+ * @brief Session-wide read-only connection to the extracted server database
+ * along with the manifest queries prepared against it.
+ */
+typedef struct {
+  sqlite3 *db;                   /**< Connection, nullptr when closed. */
+  sqlite3_stmt *update_manifest; /**< Prepared generate-update-manifest. */
+  sqlite3_stmt *full_manifest;   /**< Prepared generate-full-file-manifest. */
+} ServerDb;
+
+static ServerDb server_db = {nullptr};
+
+/* Guards the lifetime of server_db between the update thread using it and
+   updater_shutdown() on the main thread. */
+static GMutex server_db_lock;
+static guint server_db_users = 0;          /* Guarded by server_db_lock */
+static gboolean server_db_retired = FALSE; /* Guarded by server_db_lock */
+
+typedef struct DownloadEngine DownloadEngine;
+
+/**
+ * @brief One slot of the concurrent cabinet download engine. Each slot owns an
+ * easy handle that is reused for every cabinet assigned to it.
+ */
+typedef struct {
+  DownloadEngine *engine; /**< Engine this slot belongs to. */
+  CURL *easy;             /**< Easy handle reused across transfers. */
+  const FileInfo *info;   /**< Cabinet in flight, nullptr when idle. */
+  guint index;            /**< Index of info in the engine work list. */
+  char url[FIXED_STRING_FIELD_SZ]; /**< URL of the cabinet in flight. */
+  FILE *out;              /**< Temporary file receiving decoded data. */
+  gchar *temp_path;       /**< Staged output file, nullptr when idle. */
+  CabinetDecoder decoder; /**< Decodes the cabinet as it streams in. */
+  GChecksum *md5;         /**< MD5 of the decoded data so far. */
+  guint64 received;       /**< Compressed bytes received so far. */
+  guint64 resume_from;    /**< Offset the current request started at. */
+  gboolean parked;        /**< Waiting to resume an interrupted transfer. */
+  gboolean large;         /**< Taken from the large end of the queue. */
+  gboolean resume_rejected; /**< TRUE if the server ignored the Range. */
+  gboolean sink_failed;   /**< TRUE if the data itself was rejected. */
+  curl_off_t dlnow;       /**< Bytes received so far for this transfer. */
+} TransferSlot;
+
+/**
+ * @brief Keeps a configurable number of cabinet transfers in flight through a
+ * curl multi handle and aggregates their progress.
+ */
+struct DownloadEngine {
+  CURLM *multi;           /**< Multi handle driving all transfers. */
+  TransferSlot *slots;    /**< Transfer slots, one per allowed transfer. */
+  guint slot_count;       /**< Number of entries in slots. */
+  guint window;           /**< Transfers currently allowed in flight. */
+  guint large_active;     /**< Slots holding a cabinet from the large end. */
+  guint64 bytes_received; /**< Compressed bytes received, retries included. */
+  guint64 sample_bytes;   /**< bytes_received when the period started. */
+  double sample_time;     /**< Wall clock time the period started. */
+  double sample_rate;     /**< Throughput of the last period, bytes/s. */
+  gboolean window_full;   /**< TRUE if the window was full all period. */
+  gboolean congested;     /**< TRUE once the window shrank this period. */
+  const GArray *files;    /**< FileInfo work list, indexed by position. */
+  GQueue *pending;        /**< Indices of cabinets waiting for a slot. */
+  gint *attempts;         /**< Failed attempts per cabinet. */
+  gint64 *not_before;     /**< Monotonic time a retry may start, per cabinet. */
+  guint parked;           /**< Slots waiting to resume a transfer. */
+  guint processed;        /**< Cabinets that finished downloading. */
+  guint failed;           /**< Cabinets that could not be installed. */
+  guint64 bytes_done;     /**< Compressed bytes of finished cabinets. */
+  guint64 bytes_total;    /**< Compressed bytes of all cabinets. */
+  double start_time;      /**< Wall clock time the engine started. */
+  const gchar *game_path; /**< Root of the game files. */
+  const char *patch_url;  /**< Base URL cabinet URLs are derived from. */
+  gchar *staging_path;    /**< Staging directory inside game_path. */
+  InstallLedger *ledger;  /**< Ledger updated as files are installed. */
+  ProgressData *p_data;   /**< Progress reporting state. */
+  char progress_msg[FIXED_STRING_FIELD_SZ]; /**< Overall progress label. */
+};
+
+/**
+ * @brief One manifest row checked by the repair scan.
+ */
+typedef struct {
+  const FileInfo *info;            /**< Manifest record being checked. */
+  gboolean needs_repair;           /**< Set by the scan worker. */
+  gboolean rehashed;               /**< TRUE if verified by hashing. */
+  struct stat st;                  /**< Stat tuple of a verified file. */
+} ScanEntry;
+
+/**
+ * @brief Shared state between the repair scan workers and the thread that
+ * reports their progress.
+ */
+typedef struct {
+  const gchar *game_path;          /**< Root of the game files. */
+  GHashTable *ledger;              /**< Ledger rows keyed by path, if any. */
+  GMutex lock;                     /**< Guards the fields below. */
+  GCond done_cond;                 /**< Signalled when the scan completes. */
+  guint total;                     /**< Entries queued for scanning. */
+  guint completed;                 /**< Entries scanned so far. */
+  const ScanEntry *last_completed; /**< Most recently scanned entry. */
+} ScanState;
+
 /* --- HELPER FUNCTIONS --- */
 
 /*
@@ -129,243 +304,1642 @@ static void print_size(const double bytes, char *out, const size_t sz) {
                                  bytes / (1024.0 * 1024.0));
   }
 
-  if (!success) {
-    g_error("Failed to allocate %zu bytes for file size update into buffer of "
-            "%zu bytes.",
-            required, sz);
-  }
+  if (!success) {
+    g_error("Failed to allocate %zu bytes for file size update into buffer of "
+            "%zu bytes.",
+            required, sz);
+  }
+}
+
+// Helper to print speed in kilobits or megabits
+static void print_speed(curl_off_t bytes_per_second, char *out,
+                        const size_t sz) {
+  // Convert bytes/sec -> bits/sec
+  double bits_per_second = (double)bytes_per_second * 8.0;
+  bool success;
+  size_t required;
+  // 1 Mbit/s = 1,048,576 bits/s = 1024 * 1024
+  if (bits_per_second < 1024.0 * 1024.0) {
+    // Print in kb/s
+    success = str_copy_formatted(out, &required, sz, "%.2f kb/s",
+                                 bits_per_second / 1024.0);
+  } else {
+    // Print in Mb/s
+    success = str_copy_formatted(out, &required, sz, "%.2f Mb/s",
+                                 bits_per_second / (1024.0 * 1024.0));
+  }
+
+  if (!success) {
+    g_error("Failed to allocate %zu bytes for data rate update into buffer of "
+            "%zu bytes.",
+            required, sz);
+  }
+}
+
+static double get_time_in_seconds(void) {
+  struct timeval tv;
+  gettimeofday(&tv, NULL);
+  return (double)tv.tv_sec + ((double)tv.tv_usec / 1000000.0);
+}
+
+/*
+ * retry_delay_us:
+ *
+ * Returns how long to wait before retry number 'attempt' (counting from 1) of
+ * a transfer that failed on 'easy', and logs it. The Wait value from
+ * version.ini doubles with every attempt up to RETRY_BACKOFF_CAP_MS, and up to
+ * half of it is randomly shaved off so clients that failed together do not all
+ * come back at the same moment. A Retry-After sent by the server always wins
+ * if longer. Both download_file() and the download engine schedule their
+ * retries through this, whether they wait inline or not.
+ */
+static gint64 retry_delay_us(const gint attempt, CURL *easy) {
+  gint64 delay_ms = MAX(retry_delay_ms, 0);
+  for (gint i = 1; i < attempt && delay_ms < RETRY_BACKOFF_CAP_MS; i++)
+    delay_ms *= 2;
+  delay_ms = MIN(delay_ms, RETRY_BACKOFF_CAP_MS);
+  delay_ms -= g_random_int_range(0, (gint32)(delay_ms / 2) + 1);
+  gint64 delay_us = delay_ms * 1000;
+
+  curl_off_t retry_after = 0;
+  if (curl_easy_getinfo(easy, CURLINFO_RETRY_AFTER, &retry_after) ==
+          CURLE_OK &&
+      retry_after > 0)
+    delay_us = MAX(delay_us, (gint64)retry_after * G_USEC_PER_SEC);
+
+  g_warning("Retrying in %" G_GINT64_FORMAT " milliseconds... (retry %d of %d)",
+            delay_us / 1000, attempt, max_retries);
+  return delay_us;
+}
+
+/*
+ * xfer_progress:
+ *
+ * A callback for libcurl to report data rate progress
+ */
+static int xfer_progress(void *p, curl_off_t dltotal, curl_off_t dlnow,
+                         curl_off_t ultotal, curl_off_t ulnow) {
+  ProgressData *data = p;
+  curl_off_t speed;
+  const double now = get_time_in_seconds();
+
+  if (now - data->last_update_time >= 0.15) {
+    data->last_update_time = now;
+    curl_easy_getinfo(data->easy, CURLINFO_SPEED_DOWNLOAD_T, &speed);
+
+    // Clamp inputs to zero if we receive negative values to avoid displaying
+    // invalid data.
+    print_size((double)dlnow >= 0.0 ? (double)dlnow : 0.0, data->download_now,
+               sizeof(data->download_now));
+    print_size((double)dltotal >= 0.0 ? (double)dltotal : 0.0,
+               data->download_total, sizeof(data->download_total));
+    print_speed(speed, data->download_speed, sizeof(data->download_speed));
+    size_t required;
+    constexpr size_t pbar_sz = sizeof(data->pbar_label);
+    const bool success = str_copy_formatted(
+        data->pbar_label, &required, pbar_sz, "Progress: ( %s / %s ) %s",
+        data->download_now, data->download_total, data->download_speed);
+    if (!success) {
+      g_error("Failed to allocate %zu bytes for progress bar update into "
+              "buffer of %zu bytes.",
+              required, pbar_sz);
+    }
+
+    // Like earlier, clamp result to zero if negative value is produced (invalid
+    // data, divide by zero result, etc.)
+    double progress_now = (double)dlnow / (double)dltotal;
+    if (progress_now < 0.0)
+      progress_now = 0.0;
+
+    update_progress(data->download_callback, progress_now, data->pbar_label,
+                    data->user_data);
+  }
+  return 0;
+}
+
+/*
+ * manifest_new:
+ *
+ * Creates an empty Manifest. Release it with manifest_free().
+ */
+static Manifest *manifest_new(void) {
+  const auto manifest = g_new(Manifest, 1);
+  manifest->files = g_array_new(FALSE, FALSE, sizeof(FileInfo));
+  manifest->strings = g_string_chunk_new(64 * 1024);
+  manifest->decompressed_total = 0;
+  return manifest;
+}
+
+/*
+ * manifest_append:
+ *
+ * Appends a record to 'manifest', copying its strings into the manifest's
+ * string arena.
+ */
+static void manifest_append(Manifest *manifest, const gint id,
+                            const gint version, const char *path,
+                            const char *hash, const unsigned long size,
+                            const unsigned long decompressed_size) {
+  const FileInfo info = {
+      .id = id,
+      .version = version,
+      .path = g_string_chunk_insert(manifest->strings, path ? path : ""),
+      .hash = g_string_chunk_insert(manifest->strings, hash ? hash : ""),
+      .size = size,
+      .decompressed_size = decompressed_size,
+  };
+  g_array_append_val(manifest->files, info);
+  manifest->decompressed_total += decompressed_size;
+}
+
+/*
+ * manifest_load:
+ *
+ * Runs one of the cached manifest queries against the server database and
+ * collects every row into a new Manifest. The query's @current_version
+ * parameter is bound to 'min_version' when it is given. Counts and sizes are
+ * then taken from the result instead of running the join a second time.
+ *
+ * Returns the manifest, or nullptr on SQL errors.
+ */
+static Manifest *manifest_load(sqlite3_stmt *stmt, const gint *min_version) {
+  sqlite3 *db = sqlite3_db_handle(stmt);
+  sqlite3_reset(stmt);
+  sqlite3_clear_bindings(stmt);
+
+  /* Bind the current_version parameter (the first parameter index is 1) */
+  if (min_version && sqlite3_bind_int(stmt, 1, *min_version) != SQLITE_OK) {
+    g_printerr("Error binding current version: %s\n", sqlite3_errmsg(db));
+    return nullptr;
+  }
+
+  Manifest *manifest = manifest_new();
+  int rc;
+  while ((rc = sqlite3_step(stmt)) == SQLITE_ROW) {
+    manifest_append(manifest, sqlite3_column_int(stmt, 0),
+                    sqlite3_column_int(stmt, 2),
+                    (const char *)sqlite3_column_text(stmt, 1),
+                    (const char *)sqlite3_column_text(stmt, 5),
+                    (unsigned long)sqlite3_column_int64(stmt, 3),
+                    (unsigned long)sqlite3_column_int64(stmt, 4));
+  }
+  if (rc != SQLITE_DONE) {
+    g_printerr("SQL error: %s\n", sqlite3_errmsg(db));
+    manifest_free(manifest);
+    manifest = nullptr;
+  }
+  sqlite3_reset(stmt);
+  return manifest;
+}
+
+/*
+ * manifest_directories:
+ *
+ * Derives every directory the files in 'manifest' live in with one pass over
+ * their paths. Each directory is returned once, relative to the game
+ * directory and after all of its parents, in an array that owns the strings.
+ */
+static GPtrArray *manifest_directories(const Manifest *manifest) {
+  GPtrArray *directories = g_ptr_array_new_with_free_func(g_free);
+  GHashTable *seen = g_hash_table_new(g_str_hash, g_str_equal);
+  GString *prefix = g_string_sized_new(256);
+
+  for (guint i = 0; i < manifest->files->len; i++) {
+    const FileInfo *info = &g_array_index(manifest->files, FileInfo, i);
+    g_string_assign(prefix, info->path);
+
+    /* Terminate the path at each separator in turn to look up its parents
+       without allocating. Parents are met before their children, so the
+       first unseen prefix is always safe to create. */
+    for (char *sep = strchr(prefix->str, '/'); sep;
+         sep = strchr(sep + 1, '/')) {
+      if (sep == prefix->str)
+        continue;
+      *sep = '\0';
+      if (!g_hash_table_contains(seen, prefix->str)) {
+        gchar *dir = g_strdup(prefix->str);
+        g_hash_table_add(seen, dir);
+        g_ptr_array_add(directories, dir);
+      }
+      *sep = '/';
+    }
+  }
+
+  g_string_free(prefix, TRUE);
+  g_hash_table_destroy(seen);
+  return directories;
+}
+
+/*
+ * manifest_file_url:
+ *
+ * Formats the download URL of a manifest record into 'buf', which must hold
+ * FIXED_STRING_FIELD_SZ bytes. URLs follow the naming convention
+ * {public_patch_url}/{patch_path}/IDNUM-VERIDNUM.cab and are only built when a
+ * transfer starts rather than stored per record.
+ */
+static void manifest_file_url(char *buf, const char *public_patch_url,
+                              const FileInfo *info) {
+  size_t required;
+  if (!str_copy_formatted(buf, &required, FIXED_STRING_FIELD_SZ,
+                          "%s/%s/%d-%d.cab", public_patch_url, patch_path,
+                          info->id, info->version)) {
+    g_error("Unable to allocate %zu bytes for cabinet URL into buffer of %zu "
+            "bytes.",
+            required, FIXED_STRING_FIELD_SZ);
+  }
+}
+
+/*
+ * config_file_path:
+ *
+ * Returns a newly allocated path for a launcher state file named 'name'. In
+ * AppImage mode it lives under the config prefix, otherwise it sits next to
+ * the launcher like version.ini does.
+ */
+static gchar *config_file_path(const char *name) {
+  if (appimage_mode)
+    return g_build_filename(configprefix_global, name, nullptr);
+  return g_strdup(name);
+}
+
+/*
+ * install_marker_read:
+ *
+ * Returns the version recorded by the install-complete marker, or -1 if there
+ * is no valid marker.
+ */
+static gint install_marker_read(void) {
+  gchar *marker_path = config_file_path(INSTALL_MARKER_NAME);
+  gchar *contents = nullptr;
+  gint version = -1;
+  if (g_file_get_contents(marker_path, &contents, nullptr, nullptr)) {
+    gchar *end = nullptr;
+    const gint64 parsed = g_ascii_strtoll(contents, &end, 10);
+    if (end != contents && parsed >= 0 && parsed <= G_MAXINT)
+      version = (gint)parsed;
+  }
+  g_free(contents);
+  g_free(marker_path);
+  return version;
+}
+
+/*
+ * install_marker_write:
+ *
+ * Records that every file of 'version' is installed and verified, which lets
+ * the next update check skip the server database while the remote version is
+ * unchanged.
+ */
+static void install_marker_write(const gint version) {
+  gchar *marker_path = config_file_path(INSTALL_MARKER_NAME);
+  gchar *contents = g_strdup_printf("%d\n", version);
+  GError *error = nullptr;
+  if (!g_file_set_contents(marker_path, contents, -1, &error)) {
+    g_warning("Unable to write install marker: %s", error->message);
+    g_clear_error(&error);
+  }
+  g_free(contents);
+  g_free(marker_path);
+}
+
+/*
+ * install_marker_clear:
+ *
+ * Removes the install-complete marker before game files are modified, so an
+ * interrupted install is never mistaken for a complete one.
+ */
+static void install_marker_clear(void) {
+  gchar *marker_path = config_file_path(INSTALL_MARKER_NAME);
+  if (unlink(marker_path) != 0 && errno != ENOENT)
+    g_warning("Unable to remove install marker: %s", g_strerror(errno));
+  g_free(marker_path);
+}
+
+/*
+ * stat_mtime_ns:
+ *
+ * Returns the modification time recorded in 'st' in nanoseconds.
+ */
+static gint64 stat_mtime_ns(const struct stat *st) {
+  return (gint64)st->st_mtim.tv_sec * G_GINT64_CONSTANT(1000000000) +
+         st->st_mtim.tv_nsec;
+}
+
+/*
+ * ledger_open:
+ *
+ * Opens (creating if needed) the local install ledger and starts a write
+ * transaction that is committed by ledger_close(). Returns FALSE if the
+ * ledger is unavailable, in which case every file is simply re-hashed.
+ */
+static gboolean ledger_open(InstallLedger *ledger) {
+  memset(ledger, 0, sizeof(*ledger));
+  gchar *ledger_path = config_file_path(INSTALL_LEDGER_NAME);
+  const int rc = sqlite3_open_v2(ledger_path, &ledger->db,
+                                 SQLITE_OPEN_READWRITE | SQLITE_OPEN_CREATE,
+                                 nullptr);
+  g_free(ledger_path);
+  if (rc != SQLITE_OK) {
+    g_warning("Unable to open install ledger: %s", sqlite3_errmsg(ledger->db));
+    sqlite3_close(ledger->db);
+    ledger->db = nullptr;
+    return FALSE;
+  }
+
+  char *err = nullptr;
+  if (sqlite3_exec(ledger->db,
+                   "PRAGMA journal_mode=WAL;"
+                   "PRAGMA synchronous=NORMAL;"
+                   "CREATE TABLE IF NOT EXISTS ledger ("
+                   "  path TEXT PRIMARY KEY,"
+                   "  size INTEGER NOT NULL,"
+                   "  mtime_ns INTEGER NOT NULL,"
+                   "  inode INTEGER NOT NULL,"
+                   "  hash TEXT NOT NULL,"
+                   "  version INTEGER NOT NULL"
+                   ") WITHOUT ROWID;"
+                   "BEGIN;",
+                   nullptr, nullptr, &err) != SQLITE_OK ||
+      sqlite3_prepare_v2(ledger->db,
+                         "INSERT OR REPLACE INTO ledger "
+                         "(path, size, mtime_ns, inode, hash, version) "
+                         "VALUES (?1, ?2, ?3, ?4, ?5, ?6);",
+                         -1, &ledger->upsert, nullptr) != SQLITE_OK) {
+    g_warning("Unable to prepare install ledger: %s",
+              err ? err : sqlite3_errmsg(ledger->db));
+    sqlite3_free(err);
+    sqlite3_close(ledger->db);
+    ledger->db = nullptr;
+    return FALSE;
+  }
+  ledger->last_commit = g_get_monotonic_time();
+  return TRUE;
+}
+
+/*
+ * ledger_checkpoint:
+ *
+ * Commits the rows recorded so far if the last commit is old enough, so that
+ * files installed before a crash or power loss are still known on the next
+ * run. The ledger doubles as the journal of an interrupted download.
+ */
+static void ledger_checkpoint(InstallLedger *ledger) {
+  const gint64 now = g_get_monotonic_time();
+  if (now - ledger->last_commit < LEDGER_CHECKPOINT_INTERVAL_US)
+    return;
+  ledger->last_commit = now;
+  char *err = nullptr;
+  if (sqlite3_exec(ledger->db, "COMMIT; BEGIN;", nullptr, nullptr, &err) !=
+      SQLITE_OK) {
+    g_warning("Unable to checkpoint install ledger: %s", err);
+    sqlite3_free(err);
+  }
+}
+
+/*
+ * ledger_close:
+ *
+ * Commits everything recorded since ledger_open() and closes the ledger.
+ */
+static void ledger_close(InstallLedger *ledger) {
+  if (!ledger->db)
+    return;
+  sqlite3_finalize(ledger->upsert);
+  char *err = nullptr;
+  if (sqlite3_exec(ledger->db, "COMMIT;", nullptr, nullptr, &err) !=
+      SQLITE_OK) {
+    g_warning("Unable to save install ledger: %s", err);
+    sqlite3_free(err);
+  }
+  sqlite3_close(ledger->db);
+  memset(ledger, 0, sizeof(*ledger));
+}
+
+/*
+ * ledger_record:
+ *
+ * Records that the file at 'path' (relative to the game directory) was
+ * verified to have 'hash' at 'version' while it had the stat tuple in 'st'.
+ */
+static void ledger_record(InstallLedger *ledger, const char *path,
+                          const struct stat *st, const char *hash,
+                          const gint version) {
+  if (!ledger || !ledger->db)
+    return;
+  sqlite3_bind_text(ledger->upsert, 1, path, -1, SQLITE_TRANSIENT);
+  sqlite3_bind_int64(ledger->upsert, 2, st->st_size);
+  sqlite3_bind_int64(ledger->upsert, 3, stat_mtime_ns(st));
+  sqlite3_bind_int64(ledger->upsert, 4, (sqlite3_int64)st->st_ino);
+  sqlite3_bind_text(ledger->upsert, 5, hash, -1, SQLITE_TRANSIENT);
+  sqlite3_bind_int(ledger->upsert, 6, version);
+  if (sqlite3_step(ledger->upsert) != SQLITE_DONE)
+    g_warning("Unable to record '%s' in install ledger: %s", path,
+              sqlite3_errmsg(ledger->db));
+  sqlite3_reset(ledger->upsert);
+  ledger_checkpoint(ledger);
+}
+
+/*
+ * ledger_load:
+ *
+ * Reads every ledger row into a hash table keyed by relative path, so the
+ * repair scan workers can consult it without touching SQLite.
+ */
+static GHashTable *ledger_load(InstallLedger *ledger) {
+  GHashTable *records =
+      g_hash_table_new_full(g_str_hash, g_str_equal, g_free, g_free);
+  if (!ledger->db)
+    return records;
+
+  sqlite3_stmt *stmt = nullptr;
+  if (sqlite3_prepare_v2(ledger->db,
+                         "SELECT path, size, mtime_ns, inode, hash, version "
+                         "FROM ledger;",
+                         -1, &stmt, nullptr) != SQLITE_OK) {
+    g_warning("Unable to read install ledger: %s", sqlite3_errmsg(ledger->db));
+    return records;
+  }
+
+  while (sqlite3_step(stmt) == SQLITE_ROW) {
+    const auto record = g_new0(LedgerRecord, 1);
+    record->size = sqlite3_column_int64(stmt, 1);
+    record->mtime_ns = sqlite3_column_int64(stmt, 2);
+    record->inode = (guint64)sqlite3_column_int64(stmt, 3);
+    g_strlcpy(record->hash, (const char *)sqlite3_column_text(stmt, 4),
+              sizeof(record->hash));
+    record->version = sqlite3_column_int(stmt, 5);
+    g_hash_table_insert(records,
+                        g_strdup((const char *)sqlite3_column_text(stmt, 0)),
+                        record);
+  }
+  sqlite3_finalize(stmt);
+  return records;
+}
+
+/*
+ * ledger_trusts:
+ *
+ * Returns TRUE if the ledger verified this exact file before: same size,
+ * modification time and inode, and the hash and version the manifest expects.
+ */
+static gboolean ledger_trusts(const LedgerRecord *record, const struct stat *st,
+                              const char *hash, const gint version) {
+  return record && record->size == st->st_size &&
+         record->mtime_ns == stat_mtime_ns(st) &&
+         record->inode == (guint64)st->st_ino && record->version == version &&
+         g_strcmp0(record->hash, hash) == 0;
+}
+
+/*
+ * compute_file_md5:
+ *
+ * Computes the MD5 checksum for the file at 'filepath', reading it in fixed
+ * size chunks so memory use stays flat no matter how large the file is. Pages
+ * that have been hashed are dropped from the page cache as we go, so a full
+ * repair scan does not evict everything else the system has cached.
+ * Returns a newly allocated hexadecimal string (which should be freed by the
+ * caller), or NULL on error.
+ */
+static char *compute_file_md5(const char *filepath) {
+  const int fd = open(filepath, O_RDONLY | O_CLOEXEC);
+  if (fd == -1)
+    return nullptr;
+  posix_fadvise(fd, 0, 0, POSIX_FADV_SEQUENTIAL);
+
+  GChecksum *checksum = g_checksum_new(G_CHECKSUM_MD5);
+  guint8 *buf = g_malloc(HASH_READ_CHUNK_SZ);
+  off_t hashed = 0;
+  off_t dropped = 0;
+  gboolean success = TRUE;
+
+  for (;;) {
+    const ssize_t n = read(fd, buf, HASH_READ_CHUNK_SZ);
+    if (n == 0)
+      break;
+    if (n < 0) {
+      if (errno == EINTR)
+        continue;
+      success = FALSE;
+      break;
+    }
+    g_checksum_update(checksum, buf, n);
+    hashed += n;
+    if (hashed - dropped >= HASH_DROP_CACHE_SZ) {
+      posix_fadvise(fd, dropped, hashed - dropped, POSIX_FADV_DONTNEED);
+      dropped = hashed;
+    }
+  }
+  posix_fadvise(fd, 0, 0, POSIX_FADV_DONTNEED);
+  close(fd);
+  g_free(buf);
+
+  char *retval =
+      success ? g_strdup(g_checksum_get_string(checksum)) : nullptr;
+  g_checksum_free(checksum);
+  return retval;
+}
+
+/*
+ * get_file_size:
+ *
+ * Returns the size (in bytes) of the file at 'filepath', or 0 if it cannot be
+ * read.
+ */
+static unsigned long get_file_size(const char *filepath) {
+  struct stat st;
+  if (stat(filepath, &st) == 0)
+    return st.st_size;
+  return 0;
+}
+
+/*
+ * staging_file_open:
+ *
+ * Creates a uniquely named hidden file in 'dir' for staging content that will
+ * later be renamed over a file in (or next to) that directory. The file is
+ * created with regular 0644 permissions so it can be installed as-is. On
+ * success, returns a writable descriptor and stores a newly allocated path in
+ * 'path'. On failure, returns -1.
+ */
+static int staging_file_open(const char *dir, gchar **path) {
+  *path = g_build_filename(dir, ".tl4l-XXXXXX", nullptr);
+  const int fd = g_mkstemp_full(*path, O_WRONLY | O_CLOEXEC, 0644);
+  if (fd == -1) {
+    g_printerr("Unable to create staging file in '%s': %s\n", dir,
+               g_strerror(errno));
+    g_clear_pointer(path, g_free);
+  }
+  return fd;
+}
+
+/*
+ * staging_file_commit:
+ *
+ * Atomically replaces 'dest_path' with the staged file at 'staged_path'. If the
+ * two turn out to be on different filesystems (e.g. a symlinked game
+ * directory) it falls back to a copying move. Returns TRUE on success.
+ */
+static gboolean staging_file_commit(const char *staged_path,
+                                    const char *dest_path) {
+  if (rename(staged_path, dest_path) == 0)
+    return TRUE;
+  if (errno != EXDEV) {
+    g_printerr("Failed to move '%s' into place: %s\n", dest_path,
+               g_strerror(errno));
+    return FALSE;
+  }
+
+  GFile *src_file = g_file_new_for_path(staged_path);
+  GFile *dest_file = g_file_new_for_path(dest_path);
+  GError *error = nullptr;
+  const gboolean moved =
+      g_file_move(src_file, dest_file, G_FILE_COPY_OVERWRITE, nullptr,
+                  nullptr, nullptr, &error);
+  if (!moved) {
+    g_printerr("Failed to move '%s' into place: %s\n", dest_path,
+               error->message);
+    g_clear_error(&error);
+  }
+  g_object_unref(src_file);
+  g_object_unref(dest_file);
+  return moved;
+}
+
+/*
+ * http_cache_lookup:
+ *
+ * Fills 'validators' with what the HTTP cache remembers about the local file
+ * 'name', provided it was last downloaded from 'url' and is still on disk at
+ * 'local_path'. Otherwise leaves them empty so the request is unconditional.
+ */
+static void http_cache_lookup(const char *name, const char *url,
+                              const char *local_path,
+                              HttpValidators *validators) {
+  memset(validators, 0, sizeof(*validators));
+  gchar *cache_path = config_file_path(HTTP_CACHE_NAME);
+  GKeyFile *keyfile = g_key_file_new();
+  gchar *cached_url = nullptr;
+  if (g_file_test(local_path, G_FILE_TEST_IS_REGULAR) &&
+      g_key_file_load_from_file(keyfile, cache_path, G_KEY_FILE_NONE,
+                                nullptr) &&
+      (cached_url = g_key_file_get_string(keyfile, name, "URL", nullptr)) &&
+      g_strcmp0(cached_url, url) == 0) {
+    gchar *etag = g_key_file_get_string(keyfile, name, "ETag", nullptr);
+    gchar *last_modified =
+        g_key_file_get_string(keyfile, name, "Last-Modified", nullptr);
+    if (etag)
+      g_strlcpy(validators->etag, etag, sizeof(validators->etag));
+    if (last_modified)
+      g_strlcpy(validators->last_modified, last_modified,
+                sizeof(validators->last_modified));
+    g_free(etag);
+    g_free(last_modified);
+  }
+  g_free(cached_url);
+  g_key_file_free(keyfile);
+  g_free(cache_path);
+}
+
+/*
+ * http_cache_store:
+ *
+ * Remembers that the local file 'name' was downloaded from 'url' along with
+ * the validators the server sent. Call this only once the downloaded content
+ * is safely in place, so the cache never vouches for a file that is not on
+ * disk.
+ */
+static void http_cache_store(const char *name, const char *url,
+                             const HttpValidators *validators) {
+  gchar *cache_path = config_file_path(HTTP_CACHE_NAME);
+  GKeyFile *keyfile = g_key_file_new();
+  g_key_file_load_from_file(keyfile, cache_path, G_KEY_FILE_KEEP_COMMENTS,
+                            nullptr);
+  g_key_file_remove_group(keyfile, name, nullptr);
+  if (validators->etag[0] != '\0' || validators->last_modified[0] != '\0') {
+    g_key_file_set_string(keyfile, name, "URL", url);
+    if (validators->etag[0] != '\0')
+      g_key_file_set_string(keyfile, name, "ETag", validators->etag);
+    if (validators->last_modified[0] != '\0')
+      g_key_file_set_string(keyfile, name, "Last-Modified",
+                            validators->last_modified);
+  }
+
+  GError *error = nullptr;
+  if (!g_key_file_save_to_file(keyfile, cache_path, &error)) {
+    g_warning("Unable to save HTTP cache: %s", error->message);
+    g_clear_error(&error);
+  }
+  g_key_file_free(keyfile);
+  g_free(cache_path);
+}
+
+/*
+ * http_validator_header:
+ *
+ * libcurl header callback collecting the ETag and Last-Modified validators of
+ * a response.
+ */
+static size_t http_validator_header(char *buffer, size_t size, size_t nitems,
+                                    void *userdata) {
+  HttpValidators *validators = userdata;
+  const size_t len = size * nitems;
+  gchar *line = g_strstrip(g_strndup(buffer, len));
+
+  if (g_ascii_strncasecmp(line, "ETag:", 5) == 0)
+    g_strlcpy(validators->etag, g_strchug(line + 5), sizeof(validators->etag));
+  else if (g_ascii_strncasecmp(line, "Last-Modified:", 14) == 0)
+    g_strlcpy(validators->last_modified, g_strchug(line + 14),
+              sizeof(validators->last_modified));
+
+  g_free(line);
+  return len;
+}
+
+/*
+ * download_file:
+ *
+ * Downloads the file at 'url' to a staging file in 'staging_dir' using libcurl.
+ * If expected_size is greater than 0, verifies that the downloaded file size
+ * matches. If 'validators' is given, any validators it holds are sent as
+ * If-None-Match/If-Modified-Since conditions and it is updated with those of
+ * the response. On success, returns a newly allocated string with the staging
+ * file path. On failure, or when the server answered 304 Not Modified (which
+ * sets validators->not_modified), returns NULL.
+ */
+static char *download_file(const char *url, const char *staging_dir,
+                           const unsigned long expected_size,
+                           ProgressData *p_data, HttpValidators *validators) {
+  gchar *template;
+  const int fd = staging_file_open(staging_dir, &template);
+  if (fd == -1)
+    return nullptr;
+  FILE *fp = fdopen(fd, "wb");
+  if (!fp) {
+    close(fd);
+    unlink(template);
+    g_free(template);
+    return nullptr;
+  }
+
+  CURL *curl = http_share_acquire();
+  if (!curl) {
+    fclose(fp);
+    unlink(template);
+    g_free(template);
+    return nullptr;
+  }
+
+  curl_easy_setopt(curl, CURLOPT_BUFFERSIZE, (128 * 1024));
+  curl_easy_setopt(curl, CURLOPT_URL, url);
+  curl_easy_setopt(curl, CURLOPT_WRITEDATA, fp);
+
+  // Hook up progress updates if we received a prefix string.
+  if (p_data) {
+    p_data->easy = curl;
+    curl_easy_setopt(curl, CURLOPT_NOPROGRESS, 0L);
+    curl_easy_setopt(curl, CURLOPT_XFERINFOFUNCTION, xfer_progress);
+    curl_easy_setopt(curl, CURLOPT_XFERINFODATA, p_data);
+  }
+
+  // Make the request conditional if we have seen this resource before.
+  struct curl_slist *headers = nullptr;
+  HttpValidators response = {0};
+  if (validators) {
+    if (validators->etag[0] != '\0') {
+      gchar *header = g_strdup_printf("If-None-Match: %s", validators->etag);
+      headers = curl_slist_append(headers, header);
+      g_free(header);
+    }
+    if (validators->last_modified[0] != '\0') {
+      gchar *header = g_strdup_printf("If-Modified-Since: %s",
+                                      validators->last_modified);
+      headers = curl_slist_append(headers, header);
+      g_free(header);
+    }
+    curl_easy_setopt(curl, CURLOPT_HTTPHEADER, headers);
+    curl_easy_setopt(curl, CURLOPT_HEADERFUNCTION, http_validator_header);
+    curl_easy_setopt(curl, CURLOPT_HEADERDATA, &response);
+  }
+
+  CURLcode res;
+  gint retry_count = 0;
+  do {
+    res = curl_easy_perform(curl);
+    if (res == CURLE_OK) {
+      break;
+    }
+
+    g_warning("curl_easy_perform() failed: %s", curl_easy_strerror(res));
+
+    retry_count++;
+    memset(&response, 0, sizeof(response));
+
+    if (retry_count < max_retries) {
+      g_usleep(retry_delay_us(retry_count, curl));
+      /* The next attempt starts from scratch, so drop what this one wrote. */
+      if (fflush(fp) != 0 || ftruncate(fileno(fp), 0) != 0)
+        break;
+      rewind(fp);
+    } else {
+      g_warning("Max retries reached. Exiting.");
+    }
+  } while (retry_count < max_retries);
+  fclose(fp);
+
+  long response_code = 0;
+  curl_easy_getinfo(curl, CURLINFO_RESPONSE_CODE, &response_code);
+  http_share_release(curl);
+  curl_slist_free_all(headers);
+
+  if (res != CURLE_OK) {
+    unlink(template);
+    g_free(template);
+    return nullptr;
+  }
+
+  if (validators) {
+    *validators = response;
+    validators->not_modified = response_code == 304;
+    if (validators->not_modified) {
+      unlink(template);
+      g_free(template);
+      return nullptr;
+    }
+  }
+
+  /* If an expected size is specified (> 0) then validate the download */
+  if (expected_size > 0) {
+    const unsigned long actual_size = get_file_size(template);
+    if (actual_size != expected_size) {
+      unlink(template);
+      g_free(template);
+      return nullptr;
+    }
+  }
+
+  return template;
+}
+
+/*
+ * cabinet_decoder_init:
+ *
+ * Prepares an in-process decoder for an easylzma cabinet (an LZMA-alone
+ * stream) that writes the decompressed data to 'out'. If 'md5' is given it is
+ * updated with every decompressed byte.
+ *
+ * Returns TRUE on success, FALSE if liblzma could not be initialized.
+ */
+static gboolean cabinet_decoder_init(CabinetDecoder *dec, FILE *out,
+                                     GChecksum *md5) {
+  memset(&dec->strm, 0, sizeof(dec->strm));
+  dec->out = out;
+  dec->md5 = md5;
+  dec->written = 0;
+  dec->finished = FALSE;
+
+  const lzma_ret ret = lzma_alone_decoder(&dec->strm, UINT64_MAX);
+  if (ret != LZMA_OK) {
+    g_warning("Unable to initialize LZMA decoder (error %d)", ret);
+    return FALSE;
+  }
+  return TRUE;
+}
+
+/*
+ * cabinet_decoder_code:
+ *
+ * Runs 'len' bytes of compressed input through the decoder, writing any
+ * produced output. Input that follows the end of the stream is ignored.
+ */
+static gboolean cabinet_decoder_code(CabinetDecoder *dec, const guint8 *buf,
+                                     const size_t len,
+                                     const lzma_action action) {
+  if (dec->finished)
+    return TRUE;
+
+  dec->strm.next_in = buf;
+  dec->strm.avail_in = len;
+  do {
+    dec->strm.next_out = dec->out_buf;
+    dec->strm.avail_out = sizeof(dec->out_buf);
+    const lzma_ret ret = lzma_code(&dec->strm, action);
+
+    const size_t produced = sizeof(dec->out_buf) - dec->strm.avail_out;
+    if (produced > 0) {
+      if (fwrite(dec->out_buf, 1, produced, dec->out) != produced)
+        return FALSE;
+      if (dec->md5)
+        g_checksum_update(dec->md5, dec->out_buf, (gssize)produced);
+      dec->written += produced;
+    }
+
+    if (ret == LZMA_STREAM_END) {
+      dec->finished = TRUE;
+      return TRUE;
+    }
+    if (ret != LZMA_OK) {
+      g_warning("LZMA decoding failed (error %d)", ret);
+      return FALSE;
+    }
+  } while (dec->strm.avail_in > 0 || dec->strm.avail_out == 0);
+
+  return TRUE;
+}
+
+/*
+ * cabinet_decoder_feed:
+ *
+ * Feeds a chunk of compressed cabinet data into the decoder.
+ */
+static gboolean cabinet_decoder_feed(CabinetDecoder *dec, const guint8 *buf,
+                                     const size_t len) {
+  return cabinet_decoder_code(dec, buf, len, LZMA_RUN);
+}
+
+/*
+ * cabinet_decoder_finish:
+ *
+ * Flushes the decoder once all input has been fed. Returns TRUE only if the
+ * LZMA stream ended cleanly, so a truncated cabinet is reported as a failure.
+ */
+static gboolean cabinet_decoder_finish(CabinetDecoder *dec) {
+  if (!cabinet_decoder_code(dec, nullptr, 0, LZMA_FINISH))
+    return FALSE;
+  return dec->finished;
+}
+
+/*
+ * cabinet_decoder_end:
+ *
+ * Releases the memory held by the decoder.
+ */
+static void cabinet_decoder_end(CabinetDecoder *dec) { lzma_end(&dec->strm); }
+
+/*
+ * extract_cabinet:
+ *
+ * Decompresses the easylzma cabinet at 'cabinet_path' in-process.
+ * 'dest_path' is where the extracted file will be placed.
+ * 'expected_size' is the expected size of the decompressed file (if > 0 it is
+ * checked).
+ *
+ * Returns TRUE on success, FALSE on failure.
+ * Note: like the unelzma tool this replaces, the cabinet file is removed on
+ * successful extraction.
+ */
+static gboolean extract_cabinet(const char *cabinet_path, const char *dest_path,
+                                unsigned long expected_size) {
+  FILE *in = fopen(cabinet_path, "rb");
+  if (!in)
+    return FALSE;
+
+  /* Decode next to the destination so a failed extraction never clobbers
+     the previous copy and success is a single rename. */
+  gchar *dest_dir = g_path_get_dirname(dest_path);
+  gchar *staged_path;
+  const int fd = staging_file_open(dest_dir, &staged_path);
+  g_free(dest_dir);
+  if (fd == -1) {
+    fclose(in);
+    return FALSE;
+  }
+  FILE *out = fdopen(fd, "wb");
+  if (!out) {
+    close(fd);
+    unlink(staged_path);
+    g_free(staged_path);
+    fclose(in);
+    return FALSE;
+  }
+
+  const auto dec = g_new(CabinetDecoder, 1);
+  gboolean success = cabinet_decoder_init(dec, out, nullptr);
+  if (success) {
+    guint8 in_buf[CABINET_IO_CHUNK_SZ];
+    size_t n;
+    while (success && (n = fread(in_buf, 1, sizeof(in_buf), in)) > 0)
+      success = cabinet_decoder_feed(dec, in_buf, n);
+    if (success && ferror(in))
+      success = FALSE;
+    if (success)
+      success = cabinet_decoder_finish(dec);
+    cabinet_decoder_end(dec);
+  }
+  const guint64 actual_size = dec->written;
+  g_free(dec);
+  fclose(in);
+  if (fclose(out) != 0)
+    success = FALSE;
+
+  if (!success || (expected_size > 0 && actual_size != expected_size) ||
+      !staging_file_commit(staged_path, dest_path)) {
+    unlink(staged_path);
+    g_free(staged_path);
+    return FALSE;
+  }
+
+  g_free(staged_path);
+  unlink(cabinet_path);
+  return TRUE;
+}
+
+static void download_engine_cleanup(DownloadEngine *engine);
+static gint cabinet_size_compare(gconstpointer a, gconstpointer b,
+                                 gpointer user_data);
+
+/*
+ * cabinet_sink_write:
+ *
+ * libcurl write callback for engine transfers. Compressed bytes are decoded,
+ * hashed and written to the output file as they arrive, so a cabinet never
+ * touches the disk in its compressed form.
+ */
+static size_t cabinet_sink_write(char *ptr, size_t size, size_t nmemb,
+                                 void *userdata) {
+  TransferSlot *slot = userdata;
+  const size_t len = size * nmemb;
+
+  if (slot->resume_from > 0 && slot->received == slot->resume_from) {
+    /* First bytes of a resumed request: only a partial response continues
+       the stream the decoder has already consumed. */
+    long response_code = 0;
+    curl_easy_getinfo(slot->easy, CURLINFO_RESPONSE_CODE, &response_code);
+    if (response_code != 206) {
+      slot->resume_rejected = TRUE;
+      return 0;
+    }
+  }
+
+  slot->received += len;
+  slot->engine->bytes_received += len;
+  if (slot->info->size > 0 && slot->received > slot->info->size) {
+    g_warning("Cabinet %s is larger than expected", slot->url);
+    slot->sink_failed = TRUE;
+    return 0;
+  }
+
+  if (!cabinet_decoder_feed(&slot->decoder, (const guint8 *)ptr, len)) {
+    slot->sink_failed = TRUE;
+    return 0;
+  }
+  return len;
+}
+
+/*
+ * transfer_slot_release:
+ *
+ * Tears down the decoder and output file of a slot and marks it idle. The
+ * staged output file is removed unless it has already been moved into place.
+ */
+static void transfer_slot_release(TransferSlot *slot,
+                                  const gboolean remove_output) {
+  cabinet_decoder_end(&slot->decoder);
+  if (slot->out) {
+    fclose(slot->out);
+    slot->out = nullptr;
+  }
+  if (remove_output && slot->temp_path)
+    unlink(slot->temp_path);
+  g_clear_pointer(&slot->temp_path, g_free);
+  if (slot->info && slot->large)
+    slot->engine->large_active--;
+  slot->large = FALSE;
+  slot->info = nullptr;
+  slot->dlnow = 0;
+  slot->resume_from = 0;
+  slot->resume_rejected = FALSE;
+}
+
+/*
+ * transfer_slot_install:
+ *
+ * Completes a cabinet whose transfer succeeded. The compressed size, the
+ * decompressed size and the MD5 hash computed while streaming are validated
+ * against the manifest entry before the staged file is renamed over its final
+ * location.
+ *
+ * Returns TRUE on success, FALSE on failure.
+ */
+static gboolean transfer_slot_install(TransferSlot *slot) {
+  const FileInfo *info = slot->info;
+
+  if (!cabinet_decoder_finish(&slot->decoder)) {
+    g_printerr("Extraction failed for %s\n", slot->url);
+    return FALSE;
+  }
+
+  if (info->size > 0 && slot->received != info->size) {
+    g_printerr("Error downloading %s\n", slot->url);
+    return FALSE;
+  }
+
+  if (info->decompressed_size > 0 &&
+      slot->decoder.written != info->decompressed_size) {
+    g_printerr("Extraction failed for %s\n", slot->url);
+    return FALSE;
+  }
+
+  if (g_strcmp0(g_checksum_get_string(slot->md5), info->hash) != 0) {
+    g_printerr("Hash mismatch for %s\n", info->path);
+    return FALSE;
+  }
+
+  if (fclose(slot->out) != 0) {
+    slot->out = nullptr;
+    g_printerr("Failed to write extracted file for %s\n", info->path);
+    return FALSE;
+  }
+  slot->out = nullptr;
+
+  gchar *dest_path =
+      g_build_filename(slot->engine->game_path, info->path, nullptr);
+  const gboolean retval = staging_file_commit(slot->temp_path, dest_path);
+  if (retval) {
+    struct stat st;
+    if (stat(dest_path, &st) == 0)
+      ledger_record(slot->engine->ledger, info->path, &st, info->hash,
+                    info->version);
+  }
+  g_free(dest_path);
+  return retval;
+}
+
+/*
+ * transfer_progress:
+ *
+ * A callback for libcurl that records how far along a single engine transfer
+ * is. Reporting is left to the engine loop so that all transfers are
+ * aggregated into one progress bar update.
+ */
+static int transfer_progress(void *p, curl_off_t dltotal, curl_off_t dlnow,
+                             curl_off_t ultotal, curl_off_t ulnow) {
+  TransferSlot *slot = p;
+  slot->dlnow = (curl_off_t)slot->resume_from + (dlnow > 0 ? dlnow : 0);
+  return 0;
+}
+
+/*
+ * staging_dir_sweep:
+ *
+ * Removes files left behind in the staging directory by a run that was
+ * interrupted before it could clean up after itself.
+ */
+static void staging_dir_sweep(const gchar *staging_path) {
+  GDir *dir = g_dir_open(staging_path, 0, nullptr);
+  if (!dir)
+    return;
+  const gchar *name;
+  while ((name = g_dir_read_name(dir)) != nullptr) {
+    if (!g_str_has_prefix(name, ".tl4l-"))
+      continue;
+    gchar *stale_path = g_build_filename(staging_path, name, nullptr);
+    unlink(stale_path);
+    g_free(stale_path);
+  }
+  g_dir_close(dir);
+}
+
+/*
+ * download_engine_init:
+ *
+ * Prepares an engine to install every cabinet in 'manifest' under the game
+ * path in 'data' with up to 'concurrency' transfers in flight. Returns FALSE if
+ * curl or the staging directory could not be set up, in which case nothing
+ * needs to be cleaned up.
+ */
+static gboolean download_engine_init(DownloadEngine *engine,
+                                     const Manifest *manifest,
+                                     const UpdateData *data,
+                                     const gint concurrency,
+                                     InstallLedger *ledger,
+                                     ProgressData *p_data) {
+  memset(engine, 0, sizeof(*engine));
+  engine->staging_path =
+      g_build_filename(data->game_path, STAGING_DIR_NAME, nullptr);
+  if (g_mkdir_with_parents(engine->staging_path, 0755) != 0) {
+    g_printerr("Unable to create staging directory '%s': %s\n",
+               engine->staging_path, g_strerror(errno));
+    g_free(engine->staging_path);
+    return FALSE;
+  }
+  staging_dir_sweep(engine->staging_path);
+
+  engine->multi = curl_multi_init();
+  if (!engine->multi) {
+    g_rmdir(engine->staging_path);
+    g_free(engine->staging_path);
+    return FALSE;
+  }
+
+  engine->game_path = data->game_path;
+  engine->patch_url = data->public_patch_url;
+  engine->p_data = p_data;
+  engine->ledger = ledger;
+  engine->files = manifest->files;
+  engine->attempts = g_new0(gint, engine->files->len);
+  engine->not_before = g_new0(gint64, engine->files->len);
+  engine->pending = g_queue_new();
+
+  /* Files an interrupted run already installed are in the ledger with the
+     version and hash we want, so they count as done straight away. */
+  GHashTable *journal =
+      ledger ? ledger_load(ledger)
+             : g_hash_table_new_full(g_str_hash, g_str_equal, g_free, g_free);
+  for (guint i = 0; i < engine->files->len; i++) {
+    const FileInfo *info = &g_array_index(engine->files, FileInfo, i);
+    engine->bytes_total += info->size;
+
+    const LedgerRecord *record = g_hash_table_lookup(journal, info->path);
+    struct stat st;
+    gboolean installed = FALSE;
+    if (record) {
+      gchar *dest_path =
+          g_build_filename(data->game_path, info->path, nullptr);
+      installed = stat(dest_path, &st) == 0 &&
+                  ledger_trusts(record, &st, info->hash, info->version);
+      g_free(dest_path);
+    }
+    if (installed) {
+      engine->processed++;
+      engine->bytes_done += info->size;
+    } else {
+      g_queue_push_tail(engine->pending, GUINT_TO_POINTER(i));
+    }
+  }
+  g_hash_table_destroy(journal);
+  g_queue_sort(engine->pending, cabinet_size_compare, (gpointer)engine->files);
+  if (engine->processed > 0)
+    g_message("Skipping %u files installed by an earlier run",
+              engine->processed);
+
+  engine->slot_count = CLAMP(concurrency, 1, 64);
+  engine->slots = g_new0(TransferSlot, engine->slot_count);
+  for (guint i = 0; i < engine->slot_count; i++) {
+    TransferSlot *slot = &engine->slots[i];
+    slot->engine = engine;
+    slot->md5 = g_checksum_new(G_CHECKSUM_MD5);
+    slot->easy = http_share_acquire();
+    if (!slot->easy) {
+      engine->slot_count = i + 1;
+      download_engine_cleanup(engine);
+      return FALSE;
+    }
+  }
+
+  curl_multi_setopt(engine->multi, CURLMOPT_MAX_TOTAL_CONNECTIONS,
+                    (long)engine->slot_count);
+  engine->window = MIN(ENGINE_INITIAL_WINDOW, engine->slot_count);
+  engine->start_time = get_time_in_seconds();
+  engine->sample_time = engine->start_time;
+  engine->window_full = TRUE;
+  return TRUE;
 }
 
-// Helper to print speed in kilobits or megabits
-static void print_speed(curl_off_t bytes_per_second, char *out,
-                        const size_t sz) {
-  // Convert bytes/sec -> bits/sec
-  double bits_per_second = (double)bytes_per_second * 8.0;
-  bool success;
-  size_t required;
-  // 1 Mbit/s = 1,048,576 bits/s = 1024 * 1024
-  if (bits_per_second < 1024.0 * 1024.0) {
-    // Print in kb/s
-    success = str_copy_formatted(out, &required, sz, "%.2f kb/s",
-                                 bits_per_second / 1024.0);
-  } else {
-    // Print in Mb/s
-    success = str_copy_formatted(out, &required, sz, "%.2f Mb/s",
-                                 bits_per_second / (1024.0 * 1024.0));
+/*
+ * download_engine_cleanup:
+ *
+ * Releases every resource held by an engine, including any transfer that is
+ * still in flight.
+ */
+static void download_engine_cleanup(DownloadEngine *engine) {
+  for (guint i = 0; i < engine->slot_count; i++) {
+    TransferSlot *slot = &engine->slots[i];
+    if (slot->info) {
+      curl_multi_remove_handle(engine->multi, slot->easy);
+      transfer_slot_release(slot, TRUE);
+    }
+    g_checksum_free(slot->md5);
+  }
+  curl_multi_cleanup(engine->multi);
+  /* Released last, since returning the final handle after
+     http_share_shutdown() shuts libcurl down. */
+  for (guint i = 0; i < engine->slot_count; i++)
+    http_share_release(engine->slots[i].easy);
+  g_free(engine->slots);
+  if (engine->pending)
+    g_queue_free(engine->pending);
+  g_free(engine->attempts);
+  g_free(engine->not_before);
+  /* Only succeeds once the directory is empty, which it is unless another
+     launcher instance is staging into it too. */
+  g_rmdir(engine->staging_path);
+  g_free(engine->staging_path);
+  memset(engine, 0, sizeof(*engine));
+}
+
+/*
+ * download_engine_report:
+ *
+ * Aggregates the byte counts of completed and in-flight transfers into the
+ * download progress bar. Updates are rate limited unless 'force' is set.
+ */
+static void download_engine_report(DownloadEngine *engine,
+                                   const gboolean force) {
+  ProgressData *data = engine->p_data;
+  const double now = get_time_in_seconds();
+  if (!force && now - data->last_update_time < 0.15)
+    return;
+  data->last_update_time = now;
+
+  guint64 dlnow = engine->bytes_done;
+  guint active = 0;
+  for (guint i = 0; i < engine->slot_count; i++) {
+    if (engine->slots[i].info) {
+      dlnow += engine->slots[i].dlnow;
+      active++;
+    }
   }
 
+  const double elapsed = now - engine->start_time;
+  const curl_off_t speed =
+      elapsed > 0.0 ? (curl_off_t)((double)dlnow / elapsed) : 0;
+
+  print_size((double)dlnow, data->download_now, sizeof(data->download_now));
+  print_size((double)engine->bytes_total, data->download_total,
+             sizeof(data->download_total));
+  print_speed(speed, data->download_speed, sizeof(data->download_speed));
+  size_t required;
+  constexpr size_t pbar_sz = sizeof(data->pbar_label);
+  const bool success =
+      str_copy_formatted(data->pbar_label, &required, pbar_sz,
+                         "Progress: ( %s / %s ) %s [%u/%u]", data->download_now,
+                         data->download_total, data->download_speed, active,
+                         engine->window);
   if (!success) {
-    g_error("Failed to allocate %zu bytes for data rate update into buffer of "
-            "%zu bytes.",
-            required, sz);
+    g_error("Failed to allocate %zu bytes for progress bar update into "
+            "buffer of %zu bytes.",
+            required, pbar_sz);
   }
+
+  const double progress_now =
+      engine->bytes_total > 0
+          ? (double)dlnow / (double)engine->bytes_total
+          : 0.0;
+  update_progress(data->download_callback, CLAMP(progress_now, 0.0, 1.0),
+                  data->pbar_label, data->user_data);
 }
 
-static double get_time_in_seconds(void) {
-  struct timeval tv;
-  gettimeofday(&tv, NULL);
-  return (double)tv.tv_sec + ((double)tv.tv_usec / 1000000.0);
+/*
+ * download_engine_congested:
+ *
+ * Halves the transfer window after a sign that the server or the link is
+ * overloaded. Only the first sign within a sampling period counts, since a
+ * burst of failures usually has a single cause.
+ */
+static void download_engine_congested(DownloadEngine *engine) {
+  if (engine->congested)
+    return;
+  engine->congested = TRUE;
+  engine->window = MAX(engine->window / 2, 1);
+  g_debug("Download window reduced to %u", engine->window);
 }
 
 /*
- * xfer_progress:
+ * download_engine_adapt:
  *
- * A callback for libcurl to report data rate progress
+ * Grows the transfer window by one for every sampling period in which the
+ * window was fully used and aggregate throughput still improved, up to the
+ * configured number of slots. 'saturated' tells whether the window limited the
+ * transfers started this round. Together with download_engine_congested() this
+ * settles each user near the capacity of their link without hand tuning.
  */
-static int xfer_progress(void *p, curl_off_t dltotal, curl_off_t dlnow,
-                         curl_off_t ultotal, curl_off_t ulnow) {
-  ProgressData *data = p;
-  curl_off_t speed;
-  const double now = get_time_in_seconds();
+static void download_engine_adapt(DownloadEngine *engine,
+                                  const gboolean saturated) {
+  if (!saturated)
+    engine->window_full = FALSE;
 
-  if (now - data->last_update_time >= 0.15) {
-    data->last_update_time = now;
-    curl_easy_getinfo(curl, CURLINFO_SPEED_DOWNLOAD_T, &speed);
+  const double now = get_time_in_seconds();
+  const double elapsed = now - engine->sample_time;
+  if (elapsed < ENGINE_WINDOW_PERIOD_S)
+    return;
 
-    // Clamp inputs to zero if we receive negative values to avoid displaying
-    // invalid data.
-    print_size((double)dlnow >= 0.0 ? (double)dlnow : 0.0, data->download_now,
-               sizeof(data->download_now));
-    print_size((double)dltotal >= 0.0 ? (double)dltotal : 0.0,
-               data->download_total, sizeof(data->download_total));
-    print_speed(speed, data->download_speed, sizeof(data->download_speed));
-    size_t required;
-    constexpr size_t pbar_sz = sizeof(data->pbar_label);
-    const bool success = str_copy_formatted(
-        data->pbar_label, &required, pbar_sz, "Progress: ( %s / %s ) %s",
-        data->download_now, data->download_total, data->download_speed);
-    if (!success) {
-      g_error("Failed to allocate %zu bytes for progress bar update into "
-              "buffer of %zu bytes.",
-              required, pbar_sz);
-    }
+  const double rate =
+      (double)(engine->bytes_received - engine->sample_bytes) / elapsed;
+  if (!engine->congested && engine->window_full &&
+      rate > engine->sample_rate * ENGINE_WINDOW_GAIN &&
+      engine->window < engine->slot_count)
+    engine->window++;
+
+  engine->sample_time = now;
+  engine->sample_bytes = engine->bytes_received;
+  engine->sample_rate = rate;
+  engine->window_full = TRUE;
+  engine->congested = FALSE;
+}
 
-    // Like earlier, clamp result to zero if negative value is produced (invalid
-    // data, divide by zero result, etc.)
-    double progress_now = (double)dlnow / (double)dltotal;
-    if (progress_now < 0.0)
-      progress_now = 0.0;
+/*
+ * download_engine_resume:
+ *
+ * Re-issues a parked transfer as a Range request for the bytes that are still
+ * missing once its back-off has expired. The decoder, hash and output file
+ * kept their state, so the stream simply carries on where it was cut.
+ * Returns FALSE if the slot is not ready yet.
+ */
+static gboolean download_engine_resume(DownloadEngine *engine,
+                                       TransferSlot *slot) {
+  if (engine->not_before[slot->index] > g_get_monotonic_time())
+    return FALSE;
 
-    update_progress(data->download_callback, progress_now, data->pbar_label,
-                    data->user_data);
-  }
-  return 0;
+  slot->parked = FALSE;
+  engine->parked--;
+  slot->resume_from = slot->received;
+  slot->dlnow = (curl_off_t)slot->received;
+  curl_easy_setopt(slot->easy, CURLOPT_RESUME_FROM_LARGE,
+                   (curl_off_t)slot->resume_from);
+  curl_multi_add_handle(engine->multi, slot->easy);
+  return TRUE;
 }
 
 /*
- * compute_file_md5:
+ * cabinet_size_compare:
  *
- * Computes the MD5 checksum for the file at 'filepath'.
- * Returns a newly allocated hexadecimal string (which should be freed by the
- * caller), or NULL on error.
+ * Orders indices into the engine work list by compressed size, largest first.
  */
-static char *compute_file_md5(const char *filepath) {
-  GChecksum *checksum = g_checksum_new(G_CHECKSUM_MD5);
-  gchar *contents = nullptr;
-  gssize length = 0;
-
-  if (!g_file_get_contents(filepath, &contents, (gsize *)&length, nullptr)) {
-    g_checksum_free(checksum);
-    return nullptr;
-  }
-  g_checksum_update(checksum, (const guchar *)contents, length);
-  g_free(contents);
-  char *retval = g_strdup(g_checksum_get_string(checksum));
-  g_free(checksum);
-  return retval;
+static gint cabinet_size_compare(gconstpointer a, gconstpointer b,
+                                 gpointer user_data) {
+  const GArray *files = user_data;
+  const unsigned long size_a =
+      g_array_index(files, FileInfo, GPOINTER_TO_UINT(a)).size;
+  const unsigned long size_b =
+      g_array_index(files, FileInfo, GPOINTER_TO_UINT(b)).size;
+  return size_a < size_b ? 1 : size_a > size_b ? -1 : 0;
 }
 
 /*
- * get_file_size:
+ * download_engine_enqueue:
  *
- * Returns the size (in bytes) of the file at 'filepath', or 0 if it cannot be
- * read.
+ * Puts a cabinet (back) into the pending queue, keeping it sorted by size.
  */
-static unsigned long get_file_size(const char *filepath) {
-  struct stat st;
-  if (stat(filepath, &st) == 0)
-    return st.st_size;
-  return 0;
+static void download_engine_enqueue(DownloadEngine *engine,
+                                    const guint index) {
+  g_queue_insert_sorted(engine->pending, GUINT_TO_POINTER(index),
+                        cabinet_size_compare, (gpointer)engine->files);
 }
 
 /*
- * download_file:
+ * download_engine_take:
  *
- * Downloads the file at 'url' to a temporary file using libcurl.
- * If expected_size is greater than 0, verifies that the downloaded file size
- * matches. On success, returns a newly allocated string with the temporary file
- * path. On failure, returns NULL.
+ * Removes the largest ('large' set) or smallest pending cabinet that is not
+ * backing off after a failure from the queue and stores its index in
+ * 'index'. Returns FALSE if every pending cabinet is still waiting.
  */
-static char *download_file(const char *url, const unsigned long expected_size,
-                           ProgressData *p_data) {
-  char template[] = "/tmp/updaterXXXXXX";
-  const int fd = mkstemp(template);
-  if (fd == -1)
-    return nullptr;
-  FILE *fp = fdopen(fd, "wb");
-  if (!fp) {
-    close(fd);
-    unlink(template);
-    return nullptr;
+static gboolean download_engine_take(DownloadEngine *engine,
+                                     const gboolean large, guint *index) {
+  const gint64 now = g_get_monotonic_time();
+  for (GList *link = large ? engine->pending->head : engine->pending->tail;
+       link; link = large ? link->next : link->prev) {
+    const guint candidate = GPOINTER_TO_UINT(link->data);
+    if (engine->not_before[candidate] > now)
+      continue;
+    g_queue_delete_link(engine->pending, link);
+    *index = candidate;
+    return TRUE;
   }
+  return FALSE;
+}
 
-  if (!curl) {
-    fclose(fp);
-    unlink(template);
-    return nullptr;
-  }
+/*
+ * download_engine_start:
+ *
+ * Assigns the next cabinet that is ready to be fetched to an idle slot. Up to
+ * half of the window is spent on the largest cabinets left, the rest drains
+ * the smallest ones, so long transfers start early and overlap with bursts of
+ * short ones instead of leaving slots idle at the end of the run.
+ * Returns FALSE if nothing could be started right now.
+ */
+static gboolean download_engine_start(DownloadEngine *engine,
+                                      TransferSlot *slot) {
+  const gboolean large = engine->large_active < MAX(engine->window / 2, 1);
+  guint index;
+  if (!download_engine_take(engine, large, &index))
+    return FALSE;
 
-  curl_easy_setopt(curl, CURLOPT_BUFFERSIZE, (128 * 1024));
-  curl_easy_setopt(curl, CURLOPT_URL, url);
-  curl_easy_setopt(curl, CURLOPT_WRITEDATA, fp);
+  const int fd = staging_file_open(engine->staging_path, &slot->temp_path);
+  if (fd == -1) {
+    download_engine_enqueue(engine, index);
+    return FALSE;
+  }
+  slot->out = fdopen(fd, "wb");
+  if (!slot->out) {
+    close(fd);
+    unlink(slot->temp_path);
+    g_clear_pointer(&slot->temp_path, g_free);
+    download_engine_enqueue(engine, index);
+    return FALSE;
+  }
 
-  // Hook up progress updates if we received a prefix string.
-  if (p_data) {
-    curl_easy_setopt(curl, CURLOPT_NOPROGRESS, 0L);
-    curl_easy_setopt(curl, CURLOPT_XFERINFOFUNCTION, xfer_progress);
-    curl_easy_setopt(curl, CURLOPT_XFERINFODATA, p_data);
+  g_checksum_reset(slot->md5);
+  if (!cabinet_decoder_init(&slot->decoder, slot->out, slot->md5)) {
+    fclose(slot->out);
+    slot->out = nullptr;
+    unlink(slot->temp_path);
+    g_clear_pointer(&slot->temp_path, g_free);
+    download_engine_enqueue(engine, index);
+    return FALSE;
   }
 
-  CURLcode res;
-  gint retry_count = 0;
-  do {
-    res = curl_easy_perform(curl);
-    if (res == CURLE_OK) {
-      break;
-    }
+  slot->info = &g_array_index(engine->files, FileInfo, index);
+  slot->index = index;
+  slot->large = large;
+  if (large)
+    engine->large_active++;
+  manifest_file_url(slot->url, engine->patch_url, slot->info);
+  slot->dlnow = 0;
+  slot->received = 0;
+  slot->resume_from = 0;
+  slot->resume_rejected = FALSE;
+  slot->sink_failed = FALSE;
+
+  CURL *easy = slot->easy;
+  curl_easy_setopt(easy, CURLOPT_BUFFERSIZE, (128 * 1024));
+  curl_easy_setopt(easy, CURLOPT_URL, slot->url);
+  curl_easy_setopt(easy, CURLOPT_WRITEFUNCTION, cabinet_sink_write);
+  curl_easy_setopt(easy, CURLOPT_WRITEDATA, slot);
+  curl_easy_setopt(easy, CURLOPT_FAILONERROR, 1L);
+  curl_easy_setopt(easy, CURLOPT_RESUME_FROM_LARGE, (curl_off_t)0);
+  curl_easy_setopt(easy, CURLOPT_LOW_SPEED_LIMIT, 1L);
+  curl_easy_setopt(easy, CURLOPT_LOW_SPEED_TIME, ENGINE_STALL_TIMEOUT_S);
+  curl_easy_setopt(easy, CURLOPT_PRIVATE, slot);
+  curl_easy_setopt(easy, CURLOPT_NOPROGRESS, 0L);
+  curl_easy_setopt(easy, CURLOPT_XFERINFOFUNCTION, transfer_progress);
+  curl_easy_setopt(easy, CURLOPT_XFERINFODATA, slot);
+  curl_multi_add_handle(engine->multi, easy);
+  return TRUE;
+}
 
-    g_warning("curl_easy_perform() failed: %s", curl_easy_strerror(res));
+/*
+ * download_engine_finish:
+ *
+ * Handles a transfer that libcurl reports as done. Failed transfers are
+ * retried until the retry budget from version.ini runs out: a transfer that
+ * already received data is parked and later resumed with a Range request,
+ * anything else, including a resume the server refused, is re-queued from
+ * scratch. Successful ones are validated and installed.
+ */
+static void download_engine_finish(DownloadEngine *engine, TransferSlot *slot,
+                                   const CURLcode res) {
+  const FileInfo *info = slot->info;
+  const guint index = slot->index;
 
-    retry_count++;
+  curl_multi_remove_handle(engine->multi, slot->easy);
 
-    if (retry_count < max_retries) {
-      g_warning("Retrying in %d seconds... (retry %d of %d)",
-                retry_delay_ms / 1000, retry_count, max_retries);
-      sleep(retry_delay_ms / 1000);
+  if (res != CURLE_OK) {
+    g_warning("Download of %s failed: %s", slot->url, curl_easy_strerror(res));
+    /* Timeouts, stalls and server errors mean we are asking for too much. */
+    long response_code = 0;
+    curl_easy_getinfo(slot->easy, CURLINFO_RESPONSE_CODE, &response_code);
+    if (res == CURLE_OPERATION_TIMEDOUT || response_code >= 500)
+      download_engine_congested(engine);
+    /* libcurl fails a resumed request during header processing if the
+       server answers the Range with a full 200 body, before any byte reaches
+       cabinet_sink_write(); 416 means the range itself was refused. Either
+       way the cabinet has to start over from the first byte. */
+    if (slot->resume_from > 0 &&
+        (res == CURLE_RANGE_ERROR || response_code == 416))
+      slot->resume_rejected = TRUE;
+
+    const gboolean retryable = !slot->sink_failed;
+    const gboolean resumable =
+        retryable && !slot->resume_rejected && slot->received > 0;
+    engine->attempts[index]++;
+    if (retryable && engine->attempts[index] < max_retries) {
+      /* Other transfers keep running while this one waits. */
+      engine->not_before[index] =
+          g_get_monotonic_time() +
+          retry_delay_us(engine->attempts[index], slot->easy);
+      if (resumable) {
+        slot->parked = TRUE;
+        engine->parked++;
+        return;
+      }
+      /* Releasing drops the decoder, hash and partial output, so the next
+         attempt starts from offset 0 with fresh ones. */
+      transfer_slot_release(slot, TRUE);
+      download_engine_enqueue(engine, index);
     } else {
-      g_warning("Max retries reached. Exiting.");
+      transfer_slot_release(slot, TRUE);
+      g_printerr("Error downloading %s\n", slot->url);
+      engine->failed++;
     }
-  } while (retry_count < max_retries);
-  fclose(fp);
-
-  if (res != CURLE_OK) {
-    unlink(template);
-    return nullptr;
+    return;
   }
 
-  /* If an expected size is specified (> 0) then validate the download */
-  if (expected_size > 0) {
-    const unsigned long actual_size = get_file_size(template);
-    if (actual_size != expected_size) {
-      unlink(template);
-      return nullptr;
-    }
+  engine->processed++;
+  engine->bytes_done += info->size;
+
+  gchar *file_name = g_path_get_basename(info->path);
+  size_t required;
+  const bool success = str_copy_formatted(
+      engine->progress_msg, &required, FIXED_STRING_FIELD_SZ,
+      "Installing file %u of %u: %s", engine->processed, engine->files->len,
+      file_name);
+  if (!success) {
+    g_error("Unable to allocate %zu bytes for progress message into buffer "
+            "of %zu bytes.",
+            required, FIXED_STRING_FIELD_SZ);
   }
+  g_free(file_name);
+  update_progress(engine->p_data->callback,
+                  (double)engine->processed / engine->files->len,
+                  engine->progress_msg, engine->p_data->user_data);
 
-  return g_strdup(template);
+  const gboolean installed = transfer_slot_install(slot);
+  if (!installed)
+    engine->failed++;
+  transfer_slot_release(slot, !installed);
 }
 
 /*
- * extract_cabinet:
- *
- * Uses the external 'unelzma' tool to extract the compressed file.
- * 'cabinet_path' is the downloaded compressed file.
- * 'dest_path' is where the extracted file will be placed.
- * 'expected_size' is the expected size of the decompressed file (if > 0 it is
- * checked).
+ * download_engine_run:
  *
- * Returns TRUE on success, FALSE on failure.
- * Note: unelzma is expected to remove the cabinet file on successful
- * extraction.
+ * Drives the multi handle until every cabinet has either been installed or
+ * has exhausted its retries. Returns TRUE only if every cabinet succeeded.
  */
-static gboolean extract_cabinet(const char *cabinet_path, const char *dest_path,
-                                unsigned long expected_size) {
-  char command[FIXED_STRING_FIELD_SZ];
-  /* Since unelzma is a custom app we build for use with the launcher it is
-   * expected to be bundled with the launcher */
-  size_t required;
-  bool success = false;
-  if (appimage_mode)
-    success = str_copy_formatted(command, &required, FIXED_STRING_FIELD_SZ,
-                                 "%s/usr/bin/unelzma \"%s\" \"%s\"",
-                                 appdir_global, cabinet_path, dest_path);
-  else
-    success =
-        str_copy_formatted(command, &required, FIXED_STRING_FIELD_SZ,
-                           "./unelzma \"%s\" \"%s\"", cabinet_path, dest_path);
+static gboolean download_engine_run(DownloadEngine *engine) {
+  guint active = 0;
+  while (active > 0 || engine->parked > 0 ||
+         !g_queue_is_empty(engine->pending)) {
+    for (guint i = 0; i < engine->slot_count && active < engine->window;
+         i++) {
+      TransferSlot *slot = &engine->slots[i];
+      if (slot->parked ? download_engine_resume(engine, slot)
+                       : !slot->info && download_engine_start(engine, slot))
+        active++;
+    }
+    /* Sampled before completions are drained, or any transfer finishing in a
+       period would hide that the window held back queued work. */
+    const gboolean saturated =
+        active >= engine->window && !g_queue_is_empty(engine->pending);
+
+    int running = 0;
+    const CURLMcode mc = curl_multi_perform(engine->multi, &running);
+    if (mc != CURLM_OK) {
+      g_warning("curl_multi_perform() failed: %s", curl_multi_strerror(mc));
+      return FALSE;
+    }
 
-  if (!success) {
-    g_error("Failed to allocate %zu bytes for command path string in buffer of "
-            "size %zu bytes.",
-            required, FIXED_STRING_FIELD_SZ);
+    CURLMsg *msg;
+    int queued;
+    while ((msg = curl_multi_info_read(engine->multi, &queued))) {
+      if (msg->msg != CURLMSG_DONE)
+        continue;
+      TransferSlot *slot = nullptr;
+      curl_easy_getinfo(msg->easy_handle, CURLINFO_PRIVATE, (char **)&slot);
+      download_engine_finish(engine, slot, msg->data.result);
+      active--;
+    }
+
+    download_engine_adapt(engine, saturated);
+    download_engine_report(engine, FALSE);
+
+    if (active > 0 || engine->parked > 0 ||
+        !g_queue_is_empty(engine->pending))
+      curl_multi_poll(engine->multi, nullptr, 0, 100, nullptr);
   }
-  if (system(command) != 0)
-    return FALSE;
 
-  const unsigned long actual_size = get_file_size(dest_path);
-  if (expected_size > 0 && actual_size != expected_size)
-    return FALSE;
-  return TRUE;
+  download_engine_report(engine, TRUE);
+  return engine->failed == 0;
 }
 
 /**
@@ -703,90 +2277,313 @@ gboolean extract_torrent_base_files(ProgressCallback overall_cb,
   /* This watcher activates when bsdtar exits to unblock our loop */
   d->child_watch_id = g_child_watch_add(pid, on_extract_done, d);
 
-  g_main_loop_run(d->loop);
+  g_main_loop_run(d->loop);
+
+  g_main_loop_unref(d->loop);
+  const gboolean retval = d->success;
+  g_free(archive_path);
+  g_free(d);
+
+  return retval;
+}
+
+/**
+ * @brief Writes all of 'len' bytes from 'buf' to 'fd'.
+ *
+ * @return TRUE on success, FALSE if the write failed.
+ */
+static gboolean write_fully(const int fd, const guint8 *buf, size_t len) {
+  while (len > 0) {
+    const ssize_t n = write(fd, buf, len);
+    if (n < 0) {
+      if (errno == EINTR)
+        continue;
+      return false;
+    }
+    buf += n;
+    len -= (size_t)n;
+  }
+  return true;
+}
+
+/**
+ * @brief Extracts the torrent base archive while it is still downloading.
+ *
+ * The torrent must be downloading sequentially. Every run of verified pieces
+ * at the start of the archive is fed to `bsdtar -xf -`, which reads ZIP
+ * entries from a stream as they arrive, so extraction finishes shortly after
+ * the last piece instead of starting only then.
+ *
+ * @param session Torrent session with a started sequential download.
+ * @return        TRUE if bsdtar extracted the whole archive, FALSE otherwise.
+ *                The download may still be running when this returns.
+ */
+static gboolean stream_extract_torrent(TorrentSession *session) {
+  GError *error = nullptr;
+  GPid pid;
+  gint stdin_fd;
+
+  GPtrArray *argv_array = g_ptr_array_new_with_free_func(g_free);
+  if (appimage_mode) {
+    g_ptr_array_add(argv_array,
+                    g_strdup_printf("%s/usr/bin/bsdtar", appdir_global));
+  } else {
+    g_ptr_array_add(argv_array, g_strdup("bsdtar"));
+  }
+  g_ptr_array_add(argv_array, g_strdup("-xf"));
+  g_ptr_array_add(argv_array, g_strdup("-"));
+  g_ptr_array_add(argv_array, g_strdup("-C"));
+  g_ptr_array_add(argv_array, g_strdup(gameprefix_global));
+  g_ptr_array_add(argv_array, g_strdup("--strip-components=1"));
+  g_ptr_array_add(argv_array, nullptr);
+  const auto argv = (gchar **)g_ptr_array_free(argv_array, false);
+
+  if (!g_spawn_async_with_pipes(nullptr, argv, nullptr,
+                                G_SPAWN_DO_NOT_REAP_CHILD | G_SPAWN_SEARCH_PATH,
+                                nullptr, nullptr, &pid, &stdin_fd, nullptr,
+                                nullptr, &error)) {
+    g_warning("Failed to spawn bsdtar: %s", error->message);
+    g_clear_error(&error);
+    g_strfreev(argv);
+    return false;
+  }
+  g_strfreev(argv);
+
+  /* If bsdtar exits early, writes must fail with EPIPE, not kill us. */
+  sigset_t sigpipe_set, old_mask;
+  sigemptyset(&sigpipe_set);
+  sigaddset(&sigpipe_set, SIGPIPE);
+  pthread_sigmask(SIG_BLOCK, &sigpipe_set, &old_mask);
 
-  g_main_loop_unref(d->loop);
-  const gboolean retval = d->success;
+  gchar *archive_path =
+      g_strdup_printf("%s/%s", torrentprefix_global, torrent_file_name);
+  guint8 *buf = g_malloc(CABINET_IO_CHUNK_SZ);
+  int archive_fd = -1;
+  guint64 fed = 0;
+  gboolean feeding = true;
+  gboolean fed_ok = true;
+  int state = 0;
+  while (state == 0 && feeding) {
+    guint64 available;
+    state = torrent_session_wait_verified(session, fed, &available);
+    if (state < 0)
+      break;
+    if (available > fed && archive_fd < 0) {
+      archive_fd = open(archive_path, O_RDONLY | O_CLOEXEC);
+      if (archive_fd < 0) {
+        g_warning("Failed to open %s: %s", archive_path, g_strerror(errno));
+        fed_ok = false;
+        break;
+      }
+    }
+    while (fed < available) {
+      const size_t want = MIN((guint64)CABINET_IO_CHUNK_SZ, available - fed);
+      const ssize_t n = pread(archive_fd, buf, want, (off_t)fed);
+      if (n < 0 && errno == EINTR)
+        continue;
+      if (n <= 0) {
+        fed_ok = false;
+        feeding = false;
+        break;
+      }
+      if (!write_fully(stdin_fd, buf, (size_t)n)) {
+        /* bsdtar stops reading at the central directory; its status decides */
+        fed_ok = errno == EPIPE;
+        feeding = false;
+        break;
+      }
+      fed += (guint64)n;
+    }
+  }
+  g_free(buf);
   g_free(archive_path);
-  g_free(d);
+  if (archive_fd >= 0)
+    close(archive_fd);
+
+  /* End of input lets bsdtar finish, or abort if the archive is cut short. */
+  close(stdin_fd);
+  gint wait_status = 0;
+  while (waitpid(pid, &wait_status, 0) < 0 && errno == EINTR)
+    ;
+  g_spawn_close_pid(pid);
 
-  return retval;
+  const struct timespec no_wait = {0};
+  while (sigtimedwait(&sigpipe_set, nullptr, &no_wait) > 0)
+    ;
+  pthread_sigmask(SIG_SETMASK, &old_mask, nullptr);
+
+  if (!g_spawn_check_wait_status(wait_status, &error)) {
+    g_warning("bsdtar failed to extract the streamed archive: %s",
+              error->message);
+    g_clear_error(&error);
+    return false;
+  }
+  return state >= 0 && fed_ok;
 }
 
 static gboolean download_version_ini(UpdateData *data) {
   /* Construct the URL to download the version.ini file. */
-  const gchar *version_ini_url =
+  gchar *version_ini_url =
       g_strdup_printf("%s/%s", data->public_patch_url, "version.ini");
 
-  char *version_ini_path = download_file(version_ini_url, 0, nullptr);
+  /* Stage the download next to the old copy so the swap is one rename. */
+  gchar *dest_path = config_file_path("version.ini");
+  gchar *dest_dir = g_path_get_dirname(dest_path);
+  HttpValidators validators;
+  http_cache_lookup("version.ini", version_ini_url, dest_path, &validators);
+  char *version_ini_path =
+      download_file(version_ini_url, dest_dir, 0, nullptr, &validators);
+  g_free(dest_dir);
   if (!version_ini_path) {
+    g_free(version_ini_url);
+    g_free(dest_path);
+    /* Our copy is still current */
+    if (validators.not_modified)
+      return TRUE;
     g_printerr("Failed to download version.ini\n");
     return false;
   }
 
-  GError *error = nullptr;
-  gchar *current_dir = g_get_current_dir();
-  gchar *dest_path;
+  const gboolean retval = staging_file_commit(version_ini_path, dest_path);
+  if (retval)
+    http_cache_store("version.ini", version_ini_url, &validators);
+  else
+    unlink(version_ini_path);
+  g_free(version_ini_path);
+  g_free(version_ini_url);
+  g_free(dest_path);
+  return retval;
+}
 
-  if (appimage_mode) {
-    dest_path = g_build_filename(configprefix_global, "version.ini", nullptr);
-  } else {
-    dest_path = g_build_filename(current_dir, "version.ini", nullptr);
+/*
+ * server_db_close:
+ *
+ * Finalizes the cached manifest queries and closes the server database.
+ */
+static void server_db_close(void) {
+  sqlite3_finalize(server_db.update_manifest);
+  sqlite3_finalize(server_db.full_manifest);
+  sqlite3_close(server_db.db);
+  memset(&server_db, 0, sizeof(server_db));
+}
+
+/*
+ * server_db_index:
+ *
+ * The server database ships without indexes on file_size(id, new_ver) or
+ * file_version(id, version), so every manifest query scans both tables. Adds
+ * covering indexes for the manifest joins unless this copy of the database
+ * already has them. Failure is not fatal, the queries are just slower.
+ */
+static void server_db_index(const char *db_path) {
+  sqlite3 *db = nullptr;
+  if (sqlite3_open_v2(db_path, &db, SQLITE_OPEN_READWRITE, nullptr) !=
+      SQLITE_OK) {
+    g_warning("Unable to index server database: %s", sqlite3_errmsg(db));
+    sqlite3_close(db);
+    return;
   }
 
-  GFile *src_file = g_file_new_for_path(version_ini_path);
-  GFile *dest_file = g_file_new_for_path(dest_path);
-  g_free(current_dir);
-
-  if (g_file_test(dest_path, G_FILE_TEST_EXISTS)) {
-    if (!g_file_delete(dest_file, nullptr, &error)) {
-      g_printerr(
-          "Unable to delete the old version.ini while fetching the new one.");
-      g_clear_error(&error);
-      g_object_unref(src_file);
-      g_object_unref(dest_file);
-      g_free(dest_path);
-      return FALSE;
+  /* The marker lives in a table of our own: user_version and the rest of
+     the header belong to whoever produced the database. A missing table
+     simply fails to prepare and reads as not indexed. */
+  sqlite3_stmt *stmt = nullptr;
+  int indexed_version = 0;
+  if (sqlite3_prepare_v2(db,
+                         "SELECT value FROM tl4l_meta"
+                         " WHERE key = 'index_version';",
+                         -1, &stmt, nullptr) == SQLITE_OK &&
+      sqlite3_step(stmt) == SQLITE_ROW)
+    indexed_version = sqlite3_column_int(stmt, 0);
+  sqlite3_finalize(stmt);
+
+  if (indexed_version != SERVER_DB_INDEX_VERSION) {
+    gchar *sql = g_strdup_printf(
+        "BEGIN;"
+        "CREATE INDEX IF NOT EXISTS tl4l_file_size_id_ver"
+        "  ON file_size(id, new_ver, size);"
+        "CREATE INDEX IF NOT EXISTS tl4l_file_version_id_ver"
+        "  ON file_version(id, version, size, hash);"
+        "CREATE TABLE IF NOT EXISTS tl4l_meta"
+        "  (key TEXT PRIMARY KEY, value INTEGER);"
+        "INSERT OR REPLACE INTO tl4l_meta VALUES ('index_version', %d);"
+        "COMMIT;",
+        SERVER_DB_INDEX_VERSION);
+    char *err = nullptr;
+    if (sqlite3_exec(db, sql, nullptr, nullptr, &err) != SQLITE_OK) {
+      g_warning("Unable to index server database: %s", err);
+      sqlite3_free(err);
+      sqlite3_exec(db, "ROLLBACK;", nullptr, nullptr, nullptr);
     }
+    g_free(sql);
   }
+  sqlite3_close(db);
+}
 
-  g_free(dest_path);
-
-  if (!g_file_move(src_file, dest_file, G_FILE_COPY_NONE, nullptr, nullptr,
-                   nullptr, &error)) {
-    g_printerr("Failed to move version.ini to game path: %s\n", error->message);
-    g_clear_error(&error);
-    g_object_unref(src_file);
-    g_object_unref(dest_file);
+/*
+ * server_db_open:
+ *
+ * Opens the server database read-only and memory mapped, and prepares the
+ * manifest queries once for the rest of the session. Returns FALSE on error.
+ */
+static gboolean server_db_open(const char *db_path) {
+  if (sqlite3_open_v2(db_path, &server_db.db, SQLITE_OPEN_READONLY, nullptr) !=
+      SQLITE_OK) {
+    g_printerr("Error opening database: %s\n", sqlite3_errmsg(server_db.db));
+    server_db_close();
     return FALSE;
   }
 
-  g_object_unref(src_file);
-  g_object_unref(dest_file);
+  gchar *pragmas = g_strdup_printf("PRAGMA mmap_size = %d;", SERVER_DB_MMAP_SZ);
+  sqlite3_exec(server_db.db, pragmas, nullptr, nullptr, nullptr);
+  g_free(pragmas);
+
+  if (sqlite3_prepare_v3(server_db.db, sql_generate_update_manifest, -1,
+                         SQLITE_PREPARE_PERSISTENT, &server_db.update_manifest,
+                         nullptr) != SQLITE_OK ||
+      sqlite3_prepare_v3(server_db.db, sql_generate_full_manifest, -1,
+                         SQLITE_PREPARE_PERSISTENT, &server_db.full_manifest,
+                         nullptr) != SQLITE_OK) {
+    g_printerr("SQL error: %s\n", sqlite3_errmsg(server_db.db));
+    server_db_close();
+    return FALSE;
+  }
   return TRUE;
 }
 
 /*
- * load_server_db:
+ * server_db_release:
+ *
+ * Drops the reference taken by a successful load_server_db(). The last
+ * reference closes the database if updater_shutdown() ran in the meantime.
+ */
+static void server_db_release(void) {
+  g_mutex_lock(&server_db_lock);
+  if (--server_db_users == 0 && server_db_retired)
+    server_db_close();
+  g_mutex_unlock(&server_db_lock);
+}
+
+/*
+ * server_db_refresh:
  *
  * Downloads the latest database cabinet using the "DB file" value
- * (db_cab_filename) combined with data->public_patch_url, extracts it to a
- * temporary file (with the .cab removed) and opens the resulting SQLite
- * database.
+ * (db_cab_filename) combined with data->public_patch_url and extracts it next
+ * to the launcher config. The request is conditional, so an unchanged database
+ * is neither downloaded nor extracted again. The extracted database is indexed,
+ * then opened read-only for the rest of the session. With 'skip_download' an
+ * already open database is reused as-is.
  *
- * Returns a pointer to an open sqlite3 database or NULL on error.
+ * Returns the open server database or NULL on error.
  *
  * NOTE: In a production environment the expected compressed file size should be
  * taken from version.ini.
  */
-static sqlite3 *load_server_db(UpdateData *data, gboolean skip_download) {
-  sqlite3 *db = nullptr;
+static ServerDb *server_db_refresh(UpdateData *data, gboolean skip_download) {
+  if (skip_download && server_db.db)
+    return &server_db;
 
-  gchar *db_full_path;
-  if (appimage_mode)
-    db_full_path = g_build_filename(configprefix_global, db_name, nullptr);
-  else
-    db_full_path = g_strdup(db_name);
+  gchar *db_full_path = config_file_path(db_name);
 
   /* Here we use 0 for expected_size to disable the size check.
      There is no way to know what the size of this file is in advance and no
@@ -795,32 +2592,71 @@ static sqlite3 *load_server_db(UpdateData *data, gboolean skip_download) {
     /* Construct the URL to download the DB cabinet. */
     gchar *db_url =
         g_strdup_printf("%s/%s", data->public_patch_url, db_url_path);
-    char *db_cab_path = download_file(db_url, 0, nullptr);
-    g_free(db_url);
-
-    if (!db_cab_path) {
+    gchar *db_dir = g_path_get_dirname(db_full_path);
+    HttpValidators validators;
+    http_cache_lookup(db_name, db_url, db_full_path, &validators);
+    char *db_cab_path =
+        download_file(db_url, db_dir, 0, nullptr, &validators);
+    g_free(db_dir);
+
+    if (!db_cab_path && validators.not_modified) {
+      /* The extracted copy is still current, keep using it. */
+      g_free(db_url);
+      if (server_db.db) {
+        g_free(db_full_path);
+        return &server_db;
+      }
+    } else if (!db_cab_path) {
       g_printerr("Failed to download database cab file.\n");
+      g_free(db_url);
+      g_free(db_full_path);
       return nullptr;
-    }
-
-    if (!extract_cabinet(db_cab_path, db_full_path, 0)) {
-      g_printerr("Failed to extract the database cabinet file.\n");
-      unlink(db_cab_path);
+    } else {
+      /* The connection must not outlive the file it was opened on. */
+      server_db_close();
+      if (!extract_cabinet(db_cab_path, db_full_path, 0)) {
+        g_printerr("Failed to extract the database cabinet file.\n");
+        unlink(db_cab_path);
+        g_free(db_cab_path);
+        g_free(db_url);
+        g_free(db_full_path);
+        return nullptr;
+      }
+      /* The cabinet is removed by extract_cabinet on success */
       g_free(db_cab_path);
-      return nullptr;
+      http_cache_store(db_name, db_url, &validators);
+      g_free(db_url);
     }
-    /* The cabinet is expected to be removed by unelzma on success */
-    g_free(db_cab_path);
-  }
-
-  /* Open the SQLite database */
-  if (sqlite3_open(db_full_path, &db) != SQLITE_OK) {
-    g_printerr("Error opening database: %s\n", sqlite3_errmsg(db));
-    sqlite3_close(db);
-    db = nullptr;
   }
 
+  server_db_close();
+  server_db_index(db_full_path);
+  const gboolean opened = server_db_open(db_full_path);
   g_free(db_full_path);
+  return opened ? &server_db : nullptr;
+}
+
+/*
+ * load_server_db:
+ *
+ * Refreshes and opens the server database as server_db_refresh() does, holding
+ * a reference that keeps updater_shutdown() from closing it underneath the
+ * caller. Every non-NULL result must be paired with server_db_release().
+ *
+ * Returns the open server database or NULL on error or after shutdown.
+ */
+static ServerDb *load_server_db(UpdateData *data, gboolean skip_download) {
+  g_mutex_lock(&server_db_lock);
+  const gboolean retired = server_db_retired;
+  if (!retired)
+    server_db_users++;
+  g_mutex_unlock(&server_db_lock);
+  if (retired)
+    return nullptr;
+
+  ServerDb *db = server_db_refresh(data, skip_download);
+  if (!db)
+    server_db_release();
   return db;
 }
 
@@ -832,16 +2668,7 @@ static sqlite3 *load_server_db(UpdateData *data, gboolean skip_download) {
  * Initialize globals the updater routines use.
  */
 void updater_init() {
-  curl_global_init(CURL_GLOBAL_DEFAULT);
-  curl = curl_easy_init();
-
   GError *error = nullptr;
-  generate_file_paths_gbytes = g_resources_lookup_data(
-      "/com/tera/launcher/generate-file-paths.sql", 0, &error);
-  if (!generate_file_paths_gbytes) {
-    g_error("Error loading SQL resource: %s", error->message);
-  }
-
   generate_full_file_manifest_gbytes = g_resources_lookup_data(
       "/com/tera/launcher/generate-full-file-manifest.sql", 0, &error);
   if (!generate_full_file_manifest_gbytes) {
@@ -854,69 +2681,33 @@ void updater_init() {
     g_error("Error loading SQL resource: %s", error->message);
   }
 
-  generate_update_manifest_sz_gbytes = g_resources_lookup_data(
-      "/com/tera/launcher/generate-update-manifest-sz.sql", 0, &error);
-  if (!generate_update_manifest_sz_gbytes) {
-    g_error("Error loading SQL resource: %s", error->message);
-  }
-
-  generate_full_file_manifest_count_gbytes = g_resources_lookup_data(
-      "/com/tera/launcher/generate-full-file-manifest-count.sql", 0, &error);
-  if (!generate_full_file_manifest_count_gbytes) {
-    g_error("Error loading SQL resource: %s", error->message);
-  }
-
-  generate_file_paths_count_gbytes = g_resources_lookup_data(
-      "/com/tera/launcher/generate-file-paths-count.sql", 0, &error);
-  if (!generate_file_paths_count_gbytes) {
-    g_error("Error loading SQL resource: %s", error->message);
-  }
-
   gsize size;
-  sql_generate_file_paths = g_bytes_get_data(generate_file_paths_gbytes, &size);
-  if (!sql_generate_file_paths) {
-    g_error("Could not get file paths query data from resource.");
-  }
-
   sql_generate_update_manifest =
       g_bytes_get_data(generate_update_manifest_gbytes, &size);
   if (!sql_generate_update_manifest) {
     g_error("Could not get update manifest query data from resource.");
   }
 
-  sql_generate_update_manifest_sz =
-      g_bytes_get_data(generate_update_manifest_sz_gbytes, &size);
-  if (!sql_generate_update_manifest_sz) {
-    g_error("Could not get update manifest query data from resource.");
-  }
-
   sql_generate_full_manifest =
       g_bytes_get_data(generate_full_file_manifest_gbytes, &size);
   if (!sql_generate_full_manifest) {
     g_error("Could not get full manifest query data from resource.");
   }
-
-  sql_generate_full_manifest_count =
-      g_bytes_get_data(generate_full_file_manifest_count_gbytes, &size);
-  if (!sql_generate_full_manifest_count) {
-    g_error("Could not get full manifest query count data from resource.");
-  }
-
-  sql_generate_file_paths_count =
-      g_bytes_get_data(generate_file_paths_gbytes, &size);
-  if (!sql_generate_file_paths_count) {
-    g_error("Could not get file paths query count data from resource.");
-  }
 }
 
 /*
  * updater_shutdown:
  *
- * Dispose of globals the updater routines use.
+ * Dispose of globals the updater routines use. An update thread still reading
+ * the server database keeps it open, the database is then closed when that
+ * thread releases it.
  */
 void updater_shutdown() {
-  curl_easy_cleanup(curl);
-  curl_global_cleanup();
+  g_mutex_lock(&server_db_lock);
+  server_db_retired = TRUE;
+  if (server_db_users == 0)
+    server_db_close();
+  g_mutex_unlock(&server_db_lock);
 }
 
 static gboolean parse_version_ini() {
@@ -1021,11 +2812,11 @@ static gboolean parse_version_ini() {
  * the latest information in the server database. This function uses the
  * generate-update-manifest SQL.
  *
- * Returns a GList of FileInfo structures (which must later be freed with
- * free_file_info()).
+ * Returns a Manifest (which must later be freed with manifest_free()), or
+ * nullptr if there is nothing to update or the check failed.
  */
-GList *get_files_to_update(UpdateData *data, ProgressCallback callback,
-                           gpointer user_data) {
+Manifest *get_files_to_update(UpdateData *data, ProgressCallback callback,
+                              gpointer user_data) {
   update_progress(callback, 0.0, "Checking for updates...", user_data);
 
   // If version.ini or server.db are missing, this becomes a repair operation.
@@ -1036,6 +2827,7 @@ GList *get_files_to_update(UpdateData *data, ProgressCallback callback,
     g_usleep(3000000);
     return get_files_to_repair(data, callback, user_data);
   }
+  const gint local_version = current_version;
 
   /* Fetch latest, continue with updates. We just check version.ini as a
    * shortcut to know if things have been messed with or otherwise failed to
@@ -1053,42 +2845,27 @@ GList *get_files_to_update(UpdateData *data, ProgressCallback callback,
     return nullptr;
   }
 
-  GList *update_list = nullptr;
-  sqlite3 *db = load_server_db(data, FALSE);
+  /* Nothing was released since the last install ran to completion, so there
+     is no need to fetch and query the server database at all. */
+  if (current_version == local_version &&
+      install_marker_read() == current_version) {
+    update_progress(callback, 1.0, "Game is up to date.", user_data);
+    return nullptr;
+  }
+
+  Manifest *update_list = nullptr;
+  const ServerDb *db = load_server_db(data, FALSE);
   if (!db) {
     update_progress(callback, 1.0, "Failed to download latest update database.",
                     user_data);
     return update_list;
   }
 
-  sqlite3_stmt *stmt = nullptr;
-  if (sqlite3_prepare_v2(db, sql_generate_update_manifest_sz, -1, &stmt,
-                         nullptr) != SQLITE_OK) {
-    g_printerr("SQL error: %s\n", sqlite3_errmsg(db));
-    sqlite3_close(db);
-    return update_list;
-  }
-
-  /* Bind the current_version parameter (the first parameter index is 1) */
-  if (sqlite3_bind_int(stmt, 1, current_version) != SQLITE_OK) {
-    g_printerr("Error binding current version: %s\n", sqlite3_errmsg(db));
-    sqlite3_finalize(stmt);
-    sqlite3_close(db);
-    return update_list;
-  }
-
-  if (sqlite3_prepare_v2(db, sql_generate_full_manifest_count, -1, &stmt,
-                         nullptr) != SQLITE_OK) {
-    g_printerr("SQL error: %s\n", sqlite3_errmsg(db));
-    sqlite3_close(db);
-    return update_list;
-  }
-
-  uint64_t uncompressed_sz = 0;
-  if (sqlite3_step(stmt) == SQLITE_ROW)
-    uncompressed_sz = sqlite3_column_int(stmt, 0);
-  sqlite3_finalize(stmt);
-  stmt = nullptr;
+  /* Materialise the manifest once; its totals drive the space check. */
+  update_list = manifest_load(db->update_manifest, &current_version);
+  server_db_release();
+  if (!update_list)
+    return nullptr;
 
   GError *error = nullptr;
   const guint64 free_sz = get_free_space_bytes(gameprefix_global, &error);
@@ -1096,57 +2873,93 @@ GList *get_files_to_update(UpdateData *data, ProgressCallback callback,
     update_progress(callback, 1.0, "Unable to determine free space on disk",
                     user_data);
     g_clear_error(&error);
-    return update_list;
+    manifest_free(update_list);
+    return nullptr;
   }
 
-  const uint64_t remaining_sz =
-      free_sz - (uncompressed_sz + (uncompressed_sz / 10));
-  if (remaining_sz == 0 || remaining_sz > uncompressed_sz) {
+  const guint64 update_sz = update_list->decompressed_total;
+  const uint64_t remaining_sz = free_sz - (update_sz + (update_sz / 10));
+  if (remaining_sz == 0 || remaining_sz > free_sz) {
     update_progress(callback, 1.0, "Insufficient space to perform update",
                     user_data);
-    return update_list;
+    manifest_free(update_list);
+    return nullptr;
   }
 
-  if (sqlite3_prepare_v2(db, sql_generate_update_manifest, -1, &stmt,
-                         nullptr) != SQLITE_OK) {
-    g_printerr("SQL error: %s\n", sqlite3_errmsg(db));
-    sqlite3_close(db);
-    return update_list;
+  update_progress(callback, 1.0, "Update manifest retrieved.", user_data);
+  if (update_list->files->len == 0) {
+    install_marker_write(current_version);
+    g_clear_pointer(&update_list, manifest_free);
   }
+  return update_list;
+}
 
-  /* Bind the current_version parameter (the first parameter index is 1) */
-  if (sqlite3_bind_int(stmt, 1, current_version) != SQLITE_OK) {
-    g_printerr("Error binding current version: %s\n", sqlite3_errmsg(db));
-    sqlite3_finalize(stmt);
-    sqlite3_close(db);
-    return update_list;
+/*
+ * verify_installed_file:
+ *
+ * Checks a single manifest entry against the installed copy under the game
+ * directory. A file whose stat tuple matches its install ledger row is
+ * trusted without hashing. Files whose size or hash do not match are deleted
+ * so they can be replaced. Returns TRUE if the installed file is intact.
+ */
+static gboolean verify_installed_file(const ScanState *state,
+                                      ScanEntry *entry) {
+  const FileInfo *info = entry->info;
+  gchar *processed_path =
+      g_build_filename(state->game_path, info->path, nullptr);
+  struct stat st;
+  if (stat(processed_path, &st) != 0) {
+    g_free(processed_path);
+    return FALSE;
   }
 
-  /* Iterate through results and add each file to the list. */
-  while (sqlite3_step(stmt) == SQLITE_ROW) {
-    const int id = sqlite3_column_int(stmt, 0);
-    const unsigned char *path_text = sqlite3_column_text(stmt, 1);
-    const int new_ver = sqlite3_column_int(stmt, 2);
-    const unsigned long compressed_size = sqlite3_column_int(stmt, 3);
-    const unsigned long decompressed_size = sqlite3_column_int(stmt, 4);
-    const unsigned char *hash_text = sqlite3_column_text(stmt, 5);
-
-    auto info = g_new0(FileInfo, 1);
-    info->path = g_strdup((const char *)path_text);
-    info->hash = g_strdup((const char *)hash_text);
-    info->size = compressed_size;
-    info->decompressed_size = decompressed_size;
-    /* Construct the download URL using data->public_patch_url and naming
-       convention: {public_patch_url}/{patch_path}/IDNUM-VERIDNUM.cab */
-    info->url = g_strdup_printf("%s/%s/%d-%d.cab", data->public_patch_url,
-                                patch_path, id, new_ver);
-    update_list = g_list_append(update_list, info);
+  if (state->ledger &&
+      ledger_trusts(g_hash_table_lookup(state->ledger, info->path), &st,
+                    info->hash, info->version)) {
+    g_free(processed_path);
+    return TRUE;
   }
-  sqlite3_finalize(stmt);
-  sqlite3_close(db);
 
-  update_progress(callback, 1.0, "Update manifest retrieved.", user_data);
-  return update_list;
+  /* A size mismatch already tells us the file is damaged, so only hash files
+     that could possibly be intact. */
+  gboolean intact = FALSE;
+  if ((unsigned long)st.st_size == info->decompressed_size) {
+    char *md5_result = compute_file_md5(processed_path);
+    intact = g_strcmp0(info->hash, md5_result) == 0;
+    g_free(md5_result);
+  }
+
+  if (intact) {
+    entry->rehashed = TRUE;
+    entry->st = st;
+  } else if (unlink(processed_path) != 0) {
+    // TODO: Handle this better because ya know, if we can't replace this
+    // bad file then the repair is not going to succeed :^)
+    g_printerr("Unable to delete '%s': %s", processed_path,
+               g_strerror(errno));
+  }
+  g_free(processed_path);
+  return intact;
+}
+
+/*
+ * scan_worker:
+ *
+ * Thread pool worker for the repair scan. Verifies one manifest entry and
+ * records the outcome in the entry itself so results stay in manifest order.
+ */
+static void scan_worker(gpointer job, gpointer user_data) {
+  ScanEntry *entry = job;
+  ScanState *state = user_data;
+
+  entry->needs_repair = !verify_installed_file(state, entry);
+
+  g_mutex_lock(&state->lock);
+  state->completed++;
+  state->last_completed = entry;
+  if (state->completed == state->total)
+    g_cond_signal(&state->done_cond);
+  g_mutex_unlock(&state->lock);
 }
 
 /*
@@ -1155,10 +2968,12 @@ GList *get_files_to_update(UpdateData *data, ProgressCallback callback,
  * For repair operations (e.g. missing or damaged local files), this function
  * queries the full file manifest from the server database.
  *
- * Returns a GList of FileInfo structures for files that need to be repaired.
+ * Returns a Manifest of the files that need to be repaired (which must later be
+ * freed with manifest_free()), or nullptr if nothing needs repairing or the
+ * check failed.
  */
-GList *get_files_to_repair(UpdateData *data, ProgressCallback callback,
-                           gpointer user_data) {
+Manifest *get_files_to_repair(UpdateData *data, ProgressCallback callback,
+                              gpointer user_data) {
   update_progress(callback, 0.0, "Checking for missing or damaged files...",
                   user_data);
 
@@ -1174,36 +2989,21 @@ GList *get_files_to_repair(UpdateData *data, ProgressCallback callback,
     return nullptr;
   }
 
-  GList *repair_list = nullptr;
-  sqlite3 *db = load_server_db(data, FALSE);
+  Manifest *repair_list = nullptr;
+  const ServerDb *db = load_server_db(data, FALSE);
   if (!db) {
     update_progress(callback, 1.0, "Failed to load server database.",
                     user_data);
     return repair_list;
   }
 
-  sqlite3_stmt *stmt = nullptr;
-  if (sqlite3_prepare_v2(db, sql_generate_full_manifest_count, -1, &stmt,
-                         nullptr) != SQLITE_OK) {
-    g_printerr("SQL error: %s\n", sqlite3_errmsg(db));
-    sqlite3_close(db);
-    return repair_list;
-  }
-
-  int record_count = 0;
-  if (sqlite3_step(stmt) == SQLITE_ROW)
-    record_count = sqlite3_column_int(stmt, 0);
-  sqlite3_finalize(stmt);
-  stmt = nullptr;
-
-  if (sqlite3_prepare_v2(db, sql_generate_full_manifest, -1, &stmt, nullptr) !=
-      SQLITE_OK) {
-    g_printerr("SQL error: %s\n", sqlite3_errmsg(db));
-    sqlite3_close(db);
+  /* The full manifest is loaded once and later filtered down in place to
+     the files that need repairing. */
+  Manifest *full = manifest_load(db->full_manifest, nullptr);
+  server_db_release();
+  if (!full)
     return repair_list;
-  }
 
-  guint processed = 0;
   guint64 repair_sz = 0;
   GError *error = nullptr;
   uint64_t free_sz = get_free_space_bytes(gameprefix_global, &error);
@@ -1211,279 +3011,217 @@ GList *get_files_to_repair(UpdateData *data, ProgressCallback callback,
     update_progress(callback, 1.0, "Unable to determine free space on disk",
                     user_data);
     g_clear_error(&error);
-    sqlite3_close(db);
+    manifest_free(full);
     return repair_list;
   }
 
-  while (sqlite3_step(stmt) == SQLITE_ROW) {
-    const int id = sqlite3_column_int(stmt, 0);
-    const unsigned char *path_text = sqlite3_column_text(stmt, 1);
-    const int new_ver = sqlite3_column_int(stmt, 2);
-    const unsigned long compressed_size = sqlite3_column_int(stmt, 3);
-    const unsigned long decompressed_size = sqlite3_column_int(stmt, 4);
-    const unsigned char *hash_text = sqlite3_column_text(stmt, 5);
+  GArray *files = full->files;
+  const auto entries = g_new0(ScanEntry, files->len);
+  for (guint i = 0; i < files->len; i++)
+    entries[i].info = &g_array_index(files, FileInfo, i);
+
+  /* Hash installed files across a pool sized to the machine. Workers record
+     their verdict in each entry, so the repair list below is still built in
+     manifest order. */
+  InstallLedger ledger;
+  const gboolean have_ledger = ledger_open(&ledger);
+  ScanState state = {0};
+  state.game_path = data->game_path;
+  state.total = files->len;
+  if (have_ledger && !g_getenv("TL4L_FORCE_FULL_REHASH"))
+    state.ledger = ledger_load(&ledger);
+  g_mutex_init(&state.lock);
+  g_cond_init(&state.done_cond);
+
+  GThreadPool *pool = g_thread_pool_new(
+      scan_worker, &state, (gint)g_get_num_processors(), TRUE, &error);
+  if (!pool) {
+    g_printerr("Unable to start repair scan threads: %s\n", error->message);
+    g_clear_error(&error);
+    update_progress(callback, 1.0, "Unable to start repair scan", user_data);
+    g_mutex_clear(&state.lock);
+    g_cond_clear(&state.done_cond);
+    if (state.ledger)
+      g_hash_table_unref(state.ledger);
+    ledger_close(&ledger);
+    g_free(entries);
+    manifest_free(full);
+    return repair_list;
+  }
+  for (guint i = 0; i < files->len; i++)
+    g_thread_pool_push(pool, &entries[i], nullptr);
 
-    char progress_msg[FIXED_STRING_FIELD_SZ];
-    processed++;
-    gchar *file_name = g_path_get_basename((const char *)path_text);
-    size_t required;
-    const bool success =
-        str_copy_formatted(progress_msg, &required, FIXED_STRING_FIELD_SZ,
-                           "Scanning file %u of %i: %s", processed,
-                           record_count, (const char *)file_name);
-    if (!success) {
-      g_error("Unable to allocate %zu bytes for progress message into buffer "
-              "of %zu bytes.",
-              required, FIXED_STRING_FIELD_SZ);
-    }
-    g_free(file_name);
-    update_progress(callback, (double)processed / (double)record_count,
-                    progress_msg, user_data);
+  g_mutex_lock(&state.lock);
+  while (state.completed < state.total) {
+    g_cond_wait_until(&state.done_cond, &state.lock,
+                      g_get_monotonic_time() + 100 * G_TIME_SPAN_MILLISECOND);
+    const guint completed = state.completed;
+    const ScanEntry *last = state.last_completed;
+    g_mutex_unlock(&state.lock);
 
-    gchar *processed_path =
-        g_build_filename(data->game_path, path_text, nullptr);
-    if (g_file_test(processed_path, G_FILE_TEST_EXISTS)) {
-      char *md5_result = compute_file_md5(processed_path);
-      if (strcmp((const char *)hash_text, md5_result) == 0) {
-        if (get_file_size(processed_path) == decompressed_size) {
-          /* File exists, hash matches, size matches -- nothing to do here. */
-          free(md5_result);
-          continue;
-        }
-      } else {
-        GFile *busted_file = g_file_new_for_path(processed_path);
-        if (!busted_file) {
-          // TODO: Handle this better because ya know, if we can't replace this
-          // bad file then the repair is not going to succeed :^)
-          g_printerr("Unable to delete '%s'", processed_path);
-          continue;
-        }
-
-        GError *error = nullptr;
-        if (!g_file_delete(busted_file, nullptr, &error)) {
-          // TODO: See earlier TODO.
-          g_free(busted_file);
-          g_printerr("Unable to delete '%s': %s", processed_path,
-                     error->message);
-          g_clear_error(&error);
-        }
+    if (last) {
+      char progress_msg[FIXED_STRING_FIELD_SZ];
+      gchar *file_name = g_path_get_basename(last->info->path);
+      size_t required;
+      const bool success =
+          str_copy_formatted(progress_msg, &required, FIXED_STRING_FIELD_SZ,
+                             "Scanning file %u of %u: %s", completed,
+                             state.total, (const char *)file_name);
+      if (!success) {
+        g_error("Unable to allocate %zu bytes for progress message into "
+                "buffer of %zu bytes.",
+                required, FIXED_STRING_FIELD_SZ);
       }
-      free(md5_result);
+      g_free(file_name);
+      update_progress(callback, (double)completed / (double)state.total,
+                      progress_msg, user_data);
     }
+    g_mutex_lock(&state.lock);
+  }
+  g_mutex_unlock(&state.lock);
+  g_thread_pool_free(pool, FALSE, TRUE);
+  g_mutex_clear(&state.lock);
+  g_cond_clear(&state.done_cond);
+  if (state.ledger)
+    g_hash_table_unref(state.ledger);
+
+  /* Compact the manifest down to the damaged files. Records only ever move
+     towards the front, so entries not yet visited are still intact. */
+  guint kept = 0;
+  for (guint i = 0; i < files->len; i++) {
+    const ScanEntry *entry = &entries[i];
+    const FileInfo *info = entry->info;
+    if (entry->rehashed)
+      ledger_record(&ledger, info->path, &entry->st, info->hash,
+                    info->version);
+    if (!entry->needs_repair)
+      continue;
 
-    auto info = g_new0(FileInfo, 1);
-
-    info->path = g_strdup(processed_path);
-    info->hash = g_strdup((const char *)hash_text);
-    info->size = compressed_size;
-    info->decompressed_size = decompressed_size;
-    repair_sz += decompressed_size;
-    /* Construct the URL using the same naming convention: IDNUM-VERIDNUM.cab */
-    info->url = g_strdup_printf("%s/%s/%d-%d.cab", data->public_patch_url,
-                                patch_path, id, new_ver);
-    repair_list = g_list_append(repair_list, info);
-    g_free(processed_path);
+    repair_sz += info->decompressed_size;
+    if (kept != i)
+      g_array_index(files, FileInfo, kept) = *info;
+    kept++;
   }
-  sqlite3_finalize(stmt);
-  sqlite3_close(db);
+  g_array_set_size(files, kept);
+  full->decompressed_total = repair_sz;
+  ledger_close(&ledger);
+  g_free(entries);
+  repair_list = full;
 
   const uint64_t remaining_sz = free_sz - (repair_sz + (repair_sz / 10));
   if (remaining_sz == 0 || remaining_sz > free_sz) {
     update_progress(callback, 1.0, "Insufficient disk space to perform repair",
                     user_data);
-    g_list_free_full(repair_list, free_file_info);
+    manifest_free(repair_list);
     return nullptr;
   }
 
   update_progress(callback, 1.0, "Repair manifest retrieved.", user_data);
+  if (repair_list->files->len == 0) {
+    install_marker_write(current_version);
+    g_clear_pointer(&repair_list, manifest_free);
+  }
   return repair_list;
 }
 
 /*
  * download_all_files:
  *
- * Given a list of FileInfo structures representing files to update, this
+ * Given a manifest of the files to update, this
  * function downloads, extracts, validates, and writes each updated file.
+ * Cabinets are fetched by the download engine, which keeps up to
+ * max_concurrent_downloads transfers in flight at once.
  */
-gboolean download_all_files(UpdateData *data, GList *files_to_update,
+gboolean download_all_files(UpdateData *data, const Manifest *manifest,
                             ProgressCallback callback,
                             ProgressCallback download_callback,
                             gpointer user_data) {
   gboolean overall_success = TRUE;
-  const guint total_files = g_list_length(files_to_update);
   guint processed = 0;
 
+  // Game files are about to change, the install is incomplete until the
+  // marker is written again below.
+  install_marker_clear();
+
   // We need to build the directory tree before we do anything else.
   // There will be cascading failures if this is not performed so we will simply
   // return FALSE for success if the directory tree check fails.
   update_progress(callback, 0.0, "Building game directory tree...", user_data);
 
-  sqlite3 *db = load_server_db(data, TRUE);
-  sqlite3_stmt *stmt = nullptr;
-  if (sqlite3_prepare_v2(db, sql_generate_file_paths_count, -1, &stmt,
-                         nullptr) != SQLITE_OK) {
-    g_printerr("SQL error: %s\n", sqlite3_errmsg(db));
-    sqlite3_close(db);
-    return FALSE;
-  }
-
-  int directories_count = 0;
-  if (sqlite3_step(stmt) == SQLITE_ROW)
-    directories_count = sqlite3_column_int(stmt, 0);
-  sqlite3_finalize(stmt);
-  stmt = nullptr;
-
-  if (sqlite3_prepare_v2(db, sql_generate_file_paths, -1, &stmt, nullptr) !=
-      SQLITE_OK) {
-    g_printerr("SQL error: %s\n", sqlite3_errmsg(db));
-    sqlite3_close(db);
-    return FALSE;
-  }
-
-  while (sqlite3_step(stmt) == SQLITE_ROW) {
-    const unsigned char *dir_path = sqlite3_column_text(stmt, 0);
+  GPtrArray *directories = manifest_directories(manifest);
+  for (guint i = 0; i < directories->len; i++) {
+    const char *dir_path = g_ptr_array_index(directories, i);
     char progress_msg[FIXED_STRING_FIELD_SZ];
     size_t required;
     processed++;
     const bool success =
         str_copy_formatted(progress_msg, &required, FIXED_STRING_FIELD_SZ,
-                           "Checking directory %u of %i: %s", processed,
-                           directories_count, (const char *)dir_path);
+                           "Checking directory %u of %u: %s", processed,
+                           directories->len, dir_path);
     if (!success) {
       g_error("Unable to allocate %zu bytes for progress bar message into "
               "buffer of %zu bytes.",
               required, FIXED_STRING_FIELD_SZ);
     }
-    update_progress(callback, (double)processed / directories_count,
+    update_progress(callback, (double)processed / directories->len,
                     progress_msg, user_data);
 
     gchar *processed_path =
         g_build_filename(data->game_path, dir_path, nullptr);
 
-    if (g_file_test(processed_path, G_FILE_TEST_EXISTS)) {
-      if (g_file_test(processed_path, G_FILE_TEST_IS_DIR))
+    struct stat st;
+    if (stat(processed_path, &st) == 0) {
+      if (S_ISDIR(st.st_mode)) {
+        g_free(processed_path);
         continue;
+      }
       if (remove(processed_path) != 0) {
         update_progress(callback, 1.0,
                         "Failed to remove file where directory should be",
                         user_data);
-        sqlite3_finalize(stmt);
-        sqlite3_close(db);
+        g_free(processed_path);
+        g_ptr_array_free(directories, TRUE);
         return FALSE;
       }
     }
 
-    if (g_mkdir_with_parents(processed_path, 0755) != 0) {
+    /* Parents always come first, so a plain mkdir is enough here. */
+    if (g_mkdir(processed_path, 0755) != 0 && errno != EEXIST) {
       update_progress(callback, 1.0, "Failed to create directory", user_data);
-      sqlite3_finalize(stmt);
-      sqlite3_close(db);
+      g_free(processed_path);
+      g_ptr_array_free(directories, TRUE);
       return FALSE;
     }
 
     g_free(processed_path);
   }
+  g_ptr_array_free(directories, TRUE);
 
   // Move on to the file download step.
-  sqlite3_finalize(stmt);
-  sqlite3_close(db);
   update_progress(callback, 0.0, "Downloading files...", user_data);
-  processed = 0;
-
-  for (const GList *l = files_to_update; l != NULL; l = l->next) {
-    const FileInfo *info = l->data;
-    char progress_msg[FIXED_STRING_FIELD_SZ];
-    size_t required;
-    gchar *file_name = g_path_get_basename(info->path);
-    processed++;
-    bool success = str_copy_formatted(
-        progress_msg, &required, FIXED_STRING_FIELD_SZ,
-        "Downloading file %u of %u: %s", processed, total_files, file_name);
-    if (!success) {
-      g_error("Unable to allocate %zu bytes for progress message into buffer "
-              "of %zu bytes.",
-              required, FIXED_STRING_FIELD_SZ);
-    }
-    const double current_progress = (double)processed / total_files;
-    update_progress(callback, current_progress, progress_msg, user_data);
-
-    /* Download the cabinet file for the update.
-       Validate that the downloaded file size matches the expected compressed
-       size. */
-    ProgressData p_data = {nullptr};
-    p_data.callback = callback;
-    p_data.download_callback = download_callback;
-    p_data.prefix_string = progress_msg;
-    p_data.user_data = user_data;
-    p_data.progress = current_progress;
-
-    char *cabinet_path = download_file(info->url, info->size, &p_data);
-
-    if (!cabinet_path) {
-      g_printerr("Error downloading %s\n", info->url);
-      overall_success = FALSE;
-      continue;
-    }
-
-    /* Extract the cabinet file.
-     * Create a temporary file for the extracted content.
-     */
-    char temp_extract[] = "/tmp/extractedXXXXXX";
-    const int fd = mkstemp(temp_extract);
-    if (fd == -1) {
-      g_printerr("Error creating temporary file for extraction.\n");
-      unlink(cabinet_path);
-      g_free(cabinet_path);
-      overall_success = FALSE;
-      continue;
-    }
-    close(fd);
 
-    success = str_copy_formatted(progress_msg, &required, FIXED_STRING_FIELD_SZ,
-                                 "Extracting file %u of %u: %s", processed,
-                                 total_files, file_name);
-    if (!success) {
-      g_error("Unable to allocate %zu bytes for progress message into buffer "
-              "of %zu bytes.",
-              required, FIXED_STRING_FIELD_SZ);
-    }
-    g_free(file_name);
-    update_progress(callback, current_progress, progress_msg, user_data);
-    update_progress(download_callback, 1.0, "Progress: Done!", user_data);
-    if (!extract_cabinet(cabinet_path, temp_extract, info->decompressed_size)) {
-      g_printerr("Extraction failed for %s\n", cabinet_path);
-      unlink(temp_extract);
-      overall_success = FALSE;
-      continue;
-    }
-    /* cabinet file is expected to be removed by unelzma on success */
-    g_free(cabinet_path);
-
-    /* Validate the extracted file by checking MD5 hash. */
-    char *extracted_md5 = compute_file_md5(temp_extract);
-    if (!extracted_md5 || g_strcmp0(extracted_md5, info->hash) != 0) {
-      g_printerr("Hash mismatch for %s\n", info->path);
-      g_free(extracted_md5);
-      unlink(temp_extract);
-      overall_success = FALSE;
-      continue;
-    }
-    g_free(extracted_md5);
-
-    /* Create GFile objects to use g_file_move */
-    GFile *src_file = g_file_new_for_path(temp_extract);
-    GFile *dest_file = g_file_new_for_path(info->path);
-    GError *error = nullptr;
-
-    if (!g_file_move(src_file, dest_file, G_FILE_COPY_NONE, nullptr, nullptr,
-                     nullptr, &error)) {
-      g_printerr("Failed to move file to destination: %s\n", info->path);
-      g_clear_error(&error);
-      unlink(temp_extract);
-      overall_success = FALSE;
-    }
-    g_object_unref(src_file);
-    g_object_unref(dest_file);
+  ProgressData p_data = {nullptr};
+  p_data.callback = callback;
+  p_data.download_callback = download_callback;
+  p_data.user_data = user_data;
+
+  InstallLedger ledger;
+  const gboolean have_ledger = ledger_open(&ledger);
+  DownloadEngine engine;
+  if (!download_engine_init(&engine, manifest, data, max_concurrent_downloads,
+                            have_ledger ? &ledger : nullptr, &p_data)) {
+    ledger_close(&ledger);
+    update_progress(callback, 1.0, "Failed to start the download engine.",
+                    user_data);
+    return FALSE;
   }
+  if (!download_engine_run(&engine))
+    overall_success = FALSE;
+  download_engine_cleanup(&engine);
+  ledger_close(&ledger);
+
+  if (overall_success)
+    install_marker_write(current_version);
 
   update_progress(callback, 1.0, "All downloads processed.", user_data);
   update_progress(download_callback, 1.0, "", user_data);
@@ -1491,17 +3229,15 @@ gboolean download_all_files(UpdateData *data, GList *files_to_update,
 }
 
 /*
- * free_file_info:
+ * manifest_free:
  *
- * Frees the memory allocated for a FileInfo structure.
+ * Frees a Manifest along with every record and string it holds.
  */
-void free_file_info(void *info) {
-  FileInfo *f_info = info;
-  if (f_info) {
-    g_free(f_info->path);
-    g_free(f_info->hash);
-    g_free(f_info->url);
-    g_free(f_info);
+void manifest_free(Manifest *manifest) {
+  if (manifest) {
+    g_array_free(manifest->files, TRUE);
+    g_string_chunk_free(manifest->strings);
+    g_free(manifest);
   }
 }
 
@@ -1511,8 +3247,6 @@ void on_torrent_progress(const float progress, const uint64_t downloaded,
   ProgressData *data = userdata;
 
   if (progress < 0.0f) {
-    data->torrent_download_done = true;
-    data->torrent_download_done = false;
     update_progress(data->callback, 0.0, "Unable to download from torrent",
                     data->user_data);
     update_progress(data->download_callback, 0.0,
@@ -1522,8 +3256,6 @@ void on_torrent_progress(const float progress, const uint64_t downloaded,
   }
 
   if (downloaded == total && total > 0) {
-    data->torrent_download_done = true;
-    data->torrent_download_success = true;
     update_progress(data->callback, 0.5, "Extracting base game files",
                     data->user_data);
     update_progress(data->download_callback, 1.0, "This will take awhile",
@@ -1561,13 +3293,19 @@ gboolean download_from_torrent(ProgressCallback callback,
   pd.callback = callback;
   pd.download_callback = download_callback;
   pd.user_data = user_data;
-  pd.session = torrent_session_create(on_torrent_progress, &pd);
-  pd.torrent_download_done = false;
-  pd.torrent_download_success = false;
+
+  const char *profile_name = torrent_profile_global[0] != '\0'
+                                 ? torrent_profile_global
+                                 : torrent_profile_default_global;
+  TorrentSessionProfile profile;
+  if (torrent_session_profile_lookup(profile_name, &profile) != 0)
+    g_warning("Unknown torrent session profile '%s', using the default",
+              profile_name);
+  pd.session = torrent_session_create(on_torrent_progress, &pd, &profile);
 
   uint64_t sz;
-  if (torrent_session_get_total_size(pd.session, torrent_magnet_link, &sz) !=
-      0) {
+  if (torrent_session_get_total_size(pd.session, torrent_magnet_link,
+                                     torrentprefix_global, &sz) != 0) {
     g_warning("Failed to get total size of base files: %s",
               torrent_session_get_error(pd.session));
     torrent_session_close(pd.session);
@@ -1610,7 +3348,10 @@ gboolean download_from_torrent(ProgressCallback callback,
   char overall_pbar_label[FIXED_STRING_FIELD_SZ];
   const bool success = str_copy_formatted(
       overall_pbar_label, &required, FIXED_STRING_FIELD_SZ,
-      "Downloading base game archive: %s", torrent_file_name);
+      torrent_stream_extract
+          ? "Downloading and extracting base game archive: %s"
+          : "Downloading base game archive: %s",
+      torrent_file_name);
 
   if (!success) {
     g_error("Failed to allocate %zu bytes for progress bar update into "
@@ -1620,11 +3361,27 @@ gboolean download_from_torrent(ProgressCallback callback,
 
   update_progress(callback, 0.0, overall_pbar_label, pd.user_data);
 
-  while (!pd.torrent_download_done) {
-    g_usleep(500000);
+  gboolean extracted = false;
+  if (torrent_stream_extract) {
+    if (torrent_session_set_sequential(pd.session) == 0)
+      extracted = stream_extract_torrent(pd.session);
+    else
+      g_warning("Failed to enable sequential torrent download: %s",
+                torrent_session_get_error(pd.session));
   }
 
+  const gboolean downloaded = torrent_session_wait_done(pd.session) == 0;
+  if (!downloaded)
+    g_warning("Torrent download failed: %s",
+              torrent_session_get_error(pd.session));
+
   torrent_session_close(pd.session);
   pd.session = nullptr;
-  return pd.torrent_download_success;
+
+  if (!torrent_stream_extract || !downloaded || extracted)
+    return downloaded;
+
+  // Streaming fell through, but the archive is complete on disk by now.
+  g_warning("Streaming extraction failed, extracting the complete archive");
+  return extract_torrent_base_files(callback, download_callback, user_data);
 }
\ No newline at end of file
@@ -10,15 +10,25 @@
 #include "torrent_wrapper.h"
 #include <gtk/gtk.h>
 
-// Structure to hold file information
+// Structure to hold file information. The strings point into the string
+// arena of the Manifest holding the record, and the download URL is derived
+// from id and version when the file is fetched.
 typedef struct {
-  char *path;
-  char *hash;
+  int id;
+  int version;
+  const char *path;
+  const char *hash;
   unsigned long size;
   unsigned long decompressed_size;
-  char *url;
 } FileInfo;
 
+// Contiguous list of files to install
+typedef struct {
+  GArray *files;              // FileInfo records, in install order
+  GStringChunk *strings;      // Arena holding every path and hash
+  guint64 decompressed_total; // Sum of decompressed_size over files
+} Manifest;
+
 // Structure to pass data to updater functions
 typedef struct {
   GtkProgressBar *progress_bar;
@@ -39,16 +49,16 @@ void updater_init();
 void updater_shutdown();
 
 // Function to determine files that need to be updated
-GList *get_files_to_update(UpdateData *data, ProgressCallback callback,
-                           gpointer user_data);
+Manifest *get_files_to_update(UpdateData *data, ProgressCallback callback,
+                              gpointer user_data);
 
 // Function to determine files that are missing or damaged and initiate
 // download/replacement of them
-GList *get_files_to_repair(UpdateData *data, ProgressCallback callback,
-                           gpointer user_data);
+Manifest *get_files_to_repair(UpdateData *data, ProgressCallback callback,
+                              gpointer user_data);
 
 // Function to download all files that need to be updated
-gboolean download_all_files(UpdateData *data, GList *files_to_update,
+gboolean download_all_files(UpdateData *data, const Manifest *manifest,
                             ProgressCallback callback,
                             ProgressCallback download_callback,
                             gpointer user_data);
@@ -60,6 +70,9 @@ gboolean download_all_files(UpdateData *data, GList *files_to_update,
  * @param callback A callback to update the overall update progress bar.
  * @param download_callback A callback to update the file download progress bar.
  * @param user_data Update process state object.
+ * When torrent_stream_extract is set, the archive is also extracted into the
+ * game prefix while it downloads, and extract_torrent_base_files() must not be
+ * called afterwards.
  * @return Returns TRUE if base game files are successfully acquired, otherwise
  * returns FALSE.
  */
@@ -87,7 +100,7 @@ gboolean extract_torrent_base_files(ProgressCallback overall_cb,
                                     ProgressCallback stage_cb,
                                     gpointer user_data);
 
-// Utility function to free FileInfo
-void free_file_info(void *info);
+// Utility function to free a Manifest
+void manifest_free(Manifest *manifest);
 
 #endif // UPDATER_H